@@ -15,30 +15,36 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#define _POSIX_SOURCE   /* fdopen() */
+#define _XOPEN_SOURCE 700  /* fdopen(), sigaction(), sigaltstack() */
 
 #include "logging.h"
+#include "logging_internal.h"
 
 #include <math.h>       /* modf() */
-#include <pthread.h>    /* pthread_self() */
+#include <errno.h>      /* errno, EINVAL */
+#include <fcntl.h>      /* open(), O_APPEND, O_CREAT, O_WRONLY */
+#include <pthread.h>    /* pthread_create(), pthread_self() */
+#include <signal.h>     /* sigaction(), sigaltstack(), raise() */
 #include <stdarg.h>     /* va_list, va_start(), va_copy(), va_end() */
 #include <stdio.h>      /* fdopen(), fopen(), fwrite(), perror() */
-#include <stdlib.h>     /* abort(), getenv(), strtol() */
-#include <string.h>     /* strrchr() */
+#include <stdint.h>     /* uint64_t */
+#include <stdlib.h>     /* atexit(), atoi(), free(), getenv(), malloc() */
+#include <string.h>     /* memcpy(), memset(), strncmp(), strrchr() */
+#include <sys/stat.h>   /* fstat() */
 #include <sys/time.h>   /* gettimeofday() */
-#include <time.h>       /* strftime(), localtime() */
-#include <unistd.h>     /* STDERR_FILENO, getpid() */
+#include <time.h>       /* clock_gettime(), strftime(), localtime() */
+#include <unistd.h>     /* STDERR_FILENO, close(), getpid() */
 
 #define LOGFILE_OPEN_MODE       "a"
 FILE *stdlog = NULL;
 logging_emit_func_t logging_emitter = NULL;
 
-static int g_log_level = LOG_NOTSET;
+int logging_log_level = LOG_NOTSET;
 
-static const char *g_log_format =
+const char *logging_log_format =
   "%(asctime)s - %(levelname)s - %(message)s";
 
-static const char *g_time_format =
+const char *logging_time_format =
   "%Y-%m-%d %H:%M:%S";
 
 static double g_init_time = 0.0;
@@ -63,11 +69,206 @@ static void logging_init_using_file(const char *file)
   stdlog = fopen(file, LOGFILE_OPEN_MODE);
 }
 
+/* Records that do not fit in the stack buffer are formatted again
+ * into a heap buffer of up to this many bytes.
+ */
+#define MAX_RECORD_SIZE         65536
+
+/* Buffered output.  Records accumulate in g_outbuf and are written to
+ * the file descriptor of stdlog when the buffer is full, when a record
+ * of LOG_ERROR or above comes along, when the oldest buffered record
+ * is over a second old, and at exit.  A flusher thread enforces the
+ * age even when no further records arrive.  The fatal signal handler
+ * writes out whatever is in the buffer.  g_outbuf_len only ever covers
+ * whole records, and whoever writes the buffer out takes it by swapping
+ * g_outbuf_len with 0, so the signal handler can take it without the
+ * lock and without writing out records the flusher already took.
+ */
+
+#define BUFFER_FLUSH_LEVEL      LOG_ERROR
+#define BUFFER_FLUSH_AGE        1.0     /* seconds */
+
+static char *g_outbuf = NULL;
+static size_t g_outbuf_size = 0;
+static size_t g_outbuf_len = 0;
+static double g_outbuf_since = 0.0;
+static pthread_mutex_t g_outbuf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_outbuf_filled = PTHREAD_COND_INITIALIZER;
+
+/* Must be called with g_outbuf_lock held. */
+static void logging_flush_locked()
+{
+  size_t len = __atomic_exchange_n(&g_outbuf_len, 0, __ATOMIC_ACQ_REL);
+  if (len > 0)
+    logging_write_fully(fileno(stdlog), g_outbuf, len);
+}
+
+void logging_flush()
+{
+  if (g_outbuf == NULL)
+    return;
+
+  pthread_mutex_lock(&g_outbuf_lock);
+  logging_flush_locked();
+  pthread_mutex_unlock(&g_outbuf_lock);
+}
+
+static void logging_write_buffered(const char *buf, size_t len,
+                                   logging_record_t *rec_p)
+{
+  pthread_mutex_lock(&g_outbuf_lock);
+
+  if (len > g_outbuf_size - g_outbuf_len)
+    logging_flush_locked();
+
+  if (len > g_outbuf_size)
+    logging_write_fully(fileno(stdlog), buf, len);
+  else {
+    if (g_outbuf_len == 0) {
+      g_outbuf_since = rec_p->created;
+      pthread_cond_signal(&g_outbuf_filled);
+    }
+    memcpy(g_outbuf + g_outbuf_len, buf, len);
+    __atomic_store_n(&g_outbuf_len, g_outbuf_len + len, __ATOMIC_RELEASE);
+  }
+
+  if (rec_p->levelno >= BUFFER_FLUSH_LEVEL ||
+      rec_p->created - g_outbuf_since >= BUFFER_FLUSH_AGE)
+    logging_flush_locked();
+
+  pthread_mutex_unlock(&g_outbuf_lock);
+}
+
+static void *logging_outbuf_flusher(void *arg)
+{
+  (void) arg;
+
+  pthread_mutex_lock(&g_outbuf_lock);
+  for (;;) {
+    while (g_outbuf_len == 0)
+      pthread_cond_wait(&g_outbuf_filled, &g_outbuf_lock);
+
+    double deadline = g_outbuf_since + BUFFER_FLUSH_AGE;
+    if (gettimeofday_double() < deadline) {
+      struct timespec ts;
+      ts.tv_sec = (time_t) deadline;
+      ts.tv_nsec = (long) ((deadline - (double) ts.tv_sec) * 1e9);
+      pthread_cond_timedwait(&g_outbuf_filled, &g_outbuf_lock, &ts);
+      continue;
+    }
+
+    logging_flush_locked();
+  }
+
+  return NULL;
+}
+
+static void logging_outbuf_start()
+{
+  pthread_t flusher;
+  if (pthread_create(&flusher, NULL, logging_outbuf_flusher, NULL) == 0)
+    pthread_detach(flusher);
+  atexit(logging_flush);
+}
+
+/* Time index.  A checkpoint is written before the first record that
+ * comes g_index_interval seconds or more after the previous checkpoint.
+ * Checkpoint times never go backwards, even if records of concurrent
+ * callers reach the lock slightly out of order.
+ */
+
+static int g_index_fd = -1;
+static double g_index_interval = 0.0;
+static double g_index_next = 0.0;
+static int64_t g_index_last = 0;
+static uint64_t g_index_offset = 0;
+static pthread_mutex_t g_index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int logging_index_start(const char *pathname, double interval)
+{
+  logging_ensure_initialized();
+
+  struct stat st;
+  if (stdlog == NULL || g_index_fd != -1 ||
+      fstat(fileno(stdlog), &st) == -1 || !S_ISREG(st.st_mode))
+    return -1;
+
+  if (strncmp(logging_log_format, "%(asctime)s", 11) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int fd = open(pathname, O_WRONLY | O_APPEND | O_CREAT, 0644);
+  struct stat index_st;
+  if (fd == -1)
+    return -1;
+  if (fstat(fd, &index_st) == -1) {
+    close(fd);
+    return -1;
+  }
+  if (index_st.st_size == 0)
+    logging_write_fully(fd, LOGGING_INDEX_MAGIC, 8);
+
+  pthread_mutex_lock(&g_index_lock);
+  g_index_offset = st.st_size;
+  g_index_interval = interval;
+  g_index_next = 0.0;
+  g_index_fd = fd;
+  pthread_mutex_unlock(&g_index_lock);
+  return 0;
+}
+
+static void logging_write_indexed(const char *buf, size_t len,
+                                  logging_record_t *rec_p)
+{
+  pthread_mutex_lock(&g_index_lock);
+
+  if (rec_p->created >= g_index_next) {
+    logging_index_entry_t entry;
+    entry.usec = (int64_t) (rec_p->created * 1e6);
+    if (entry.usec < g_index_last)
+      entry.usec = g_index_last;
+    entry.offset = g_index_offset;
+    logging_write_fully(g_index_fd, (const char *) &entry, sizeof(entry));
+
+    g_index_last = entry.usec;
+    g_index_next = rec_p->created + g_index_interval;
+  }
+
+  if (g_outbuf)
+    logging_write_buffered(buf, len, rec_p);
+  else
+    fwrite(buf, len, 1, stdlog);
+  g_index_offset += len;
+
+  pthread_mutex_unlock(&g_index_lock);
+}
+
 void logging_emit_stdlog(logging_record_t *rec_p)
 {
   char buf[1024];
-  size_t c = logging_formatter(rec_p, g_log_format, buf, sizeof(buf));
-  fwrite(buf, c, 1, stdlog);
+  char *big_buf = NULL;
+  strx_buf_t out;
+
+  strx_buf_init(&out, buf, sizeof(buf));
+  logging_format_record(rec_p, logging_log_format, &out);
+
+  if (strx_buf_truncated(&out) &&
+      (big_buf = (char *) malloc(MAX_RECORD_SIZE)) != NULL) {
+    strx_buf_init(&out, big_buf, MAX_RECORD_SIZE);
+    logging_format_record(rec_p, logging_log_format, &out);
+  }
+
+  /* Even a truncated record should end the line. */
+  logging_end_truncated(&out);
+
+  if (g_index_fd != -1)
+    logging_write_indexed(out.base, strx_buf_len(&out), rec_p);
+  else if (g_outbuf)
+    logging_write_buffered(out.base, strx_buf_len(&out), rec_p);
+  else
+    fwrite(out.base, strx_buf_len(&out), 1, stdlog);
+  free(big_buf);
 }
 
 void logging_ensure_initialized()
@@ -83,17 +284,30 @@ void logging_ensure_initialized()
   const char *res;
 
   if ((res = getenv("LOGGING_LOG_FORMAT")) != NULL)
-    g_log_format = res;
+    logging_log_format = res;
 
   if ((res = getenv("LOGGING_TIME_FORMAT")) != NULL)
-    g_time_format = res;
+    logging_time_format = res;
 
   if ((res = getenv("LOGGING_LOG_LEVEL")) != NULL)
-    g_log_level = strtol(res, (char **) NULL, 10);
+    logging_log_level = strtol(res, (char **) NULL, 10);
+
+  if ((res = getenv("LOGGING_DEDUP_TIMEOUT")) != NULL)
+    logging_dedup_timeout = strtod(res, (char **) NULL);
 
   if ((res = getenv("LOGGING_LOG_FILE")) != NULL)
     logging_init_using_file(res);
 
+  if ((res = getenv("LOGGING_SHM_RING")) != NULL &&
+      logging_emitter != logging_emit_shm &&
+      logging_shm_attach(res) == -1)
+    perror("!!! LOGGING_SHM_RING");
+
+  if ((res = getenv("LOGGING_SYSLOG")) != NULL &&
+      logging_emitter == logging_emit_stdlog &&
+      logging_syslog_open(res, NULL) == -1)
+    perror("!!! LOGGING_SYSLOG");
+
   /* If logging_init_using_file() did not initialize, */
   if (stdlog == NULL)
     logging_init_using_stderr();
@@ -106,9 +320,129 @@ void logging_ensure_initialized()
 
   setbuf(stdlog, NULL);  /* Set to unbuffered mode like stderr. */
 
+  if ((res = getenv("LOGGING_BUFFER_SIZE")) != NULL &&
+      (g_outbuf_size = strtoul(res, (char **) NULL, 10)) > 0 &&
+      (g_outbuf = (char *) malloc(g_outbuf_size)) != NULL)
+    logging_outbuf_start();
+
+  const char *log_file = getenv("LOGGING_LOG_FILE");
+  double interval;
+  if ((res = getenv("LOGGING_INDEX_INTERVAL")) != NULL && log_file != NULL &&
+      (interval = strtod(res, (char **) NULL)) > 0.0) {
+    char index_file[4096];
+    strxcpy(strxcpy(index_file, index_file + sizeof(index_file),
+                    log_file, SIZE_MAX),
+            index_file + sizeof(index_file), ".idx", SIZE_MAX);
+    if (logging_index_start(index_file, interval) == -1)
+      perror("!!! LOGGING_INDEX_INTERVAL");
+  }
+
+  if ((res = getenv("LOGGING_COMPRESS_BLOCK_SIZE")) != NULL &&
+      logging_emitter == logging_emit_stdlog &&
+      logging_lz_start(fileno(stdlog), strtoul(res, (char **) NULL, 10)) == -1)
+    perror("!!! LOGGING_COMPRESS_BLOCK_SIZE");
+
+  if ((res = getenv("LOGGING_CRASH_HANDLER")) != NULL && atoi(res) != 0)
+    logging_install_crash_handler();
+
   g_init_time = gettimeofday_double();
 }
 
+/* Fatal signal handling.  The handler writes out the output buffer,
+ * then a final CRIT record, then re-raises the signal with the default
+ * action.  It cannot use the log format (strftime() and localtime()
+ * are not async-signal-safe), so the final record has a fixed format,
+ * made with the allocation free strxcpy() and strxfromull() only.
+ * Compressed output and syslog output drain their own queues instead.
+ * Records already in a shared memory ring are drained by the collector.
+ */
+
+static const int k_fatal_signals[] = { SIGSEGV, SIGABRT, SIGBUS };
+
+/* The file descriptor of stdlog when the handler was installed, since
+ * fileno() is not async-signal-safe.
+ */
+static int g_crash_fd = STDERR_FILENO;
+
+static const char *string_of_fatal_signal(int signo)
+{
+  switch (signo) {
+  case SIGSEGV: return "SIGSEGV";
+  case SIGABRT: return "SIGABRT";
+  case SIGBUS: return "SIGBUS";
+  default: return "signal";
+  }
+}
+
+static void logging_crash_handler(int signo, siginfo_t *info, void *context)
+{
+  (void) context;
+
+  int fd = g_crash_fd;
+
+  static const char *k_dec = "0123456789", *k_hex = "0123456789abcdef";
+  char buf[256];
+  const char *end = buf + sizeof(buf);
+  char *p = buf;
+
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  p = strxfromull(p, end, ts.tv_sec, 10, k_dec);
+  p = strxcpy(p, end, ".", 1);
+  char usec[8];
+  char *q = strxfromull(usec, usec + sizeof(usec), ts.tv_nsec / 1000, 10, k_dec);
+  p = strxcpy(p, end, "000000", 6 - (q - usec));
+  p = strxcpy(p, end, usec, q - usec);
+  p = strxcpy(p, end, " - CRIT - process ", SIZE_MAX);
+  p = strxfromull(p, end, getpid(), 10, k_dec);
+  p = strxcpy(p, end, " caught ", SIZE_MAX);
+  p = strxcpy(p, end, string_of_fatal_signal(signo), SIZE_MAX);
+  if (signo != SIGABRT) {
+    p = strxcpy(p, end, " at address 0x", SIZE_MAX);
+    p = strxfromull(p, end, (uintptr_t) info->si_addr, 16, k_hex);
+  }
+  p = strxcpy(p, end, "\n", 1);
+
+  if (logging_lz_crash_drain(buf, p - buf) == -1 &&
+      logging_syslog_crash_drain(buf, p - buf) == -1) {
+    size_t len = __atomic_exchange_n(&g_outbuf_len, 0, __ATOMIC_ACQ_REL);
+    if (len > 0)
+      logging_write_fully(fd, g_outbuf, len);
+    logging_write_fully(fd, buf, p - buf);
+  }
+
+  /* SA_RESETHAND restored the default action, and SA_NODEFER lets the
+   * signal through right away.
+   */
+  raise(signo);
+}
+
+void logging_install_crash_handler()
+{
+  g_crash_fd = (stdlog != NULL)? fileno(stdlog) : STDERR_FILENO;
+
+  /* An alternate stack, so that stack overflows are caught too.  Only
+   * applies to the thread that installs the handler.
+   */
+  static char altstack[65536];
+  stack_t ss;
+  ss.ss_sp = altstack;
+  ss.ss_size = sizeof(altstack);
+  ss.ss_flags = 0;
+  sigaltstack(&ss, NULL);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = logging_crash_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESETHAND | SA_NODEFER | SA_ONSTACK;
+  sigemptyset(&sa.sa_mask);
+
+  size_t i;
+  for (i = 0; i < sizeof(k_fatal_signals) / sizeof(k_fatal_signals[0]); i++)
+    sigaction(k_fatal_signals[i], &sa, NULL);
+}
+
 typedef struct {
   int key;
   const char *data;
@@ -139,8 +473,165 @@ static const char *string_of_log_level(int log_level)
   return "UNDEFINED";
 }
 
-void logging_vprintf(const char *pathname, int lineno, const char *func_name,
-                     int levelno, const char *msg, va_list ap)
+/* Per-thread context.  Keys and values are copied into strings, and
+ * each push appends its pair to both renderings, so a pop only has to
+ * go back to the lengths saved at the push.
+ */
+
+typedef struct {
+  logging_context_pair_t pairs[LOGGING_CONTEXT_MAX_DEPTH];
+  size_t strings_len[LOGGING_CONTEXT_MAX_DEPTH];
+  size_t rendered_len[LOGGING_CONTEXT_MAX_DEPTH];
+  size_t json_len[LOGGING_CONTEXT_MAX_DEPTH];
+  int count;
+  char strings[LOGGING_CONTEXT_SIZE];
+  char rendered[LOGGING_CONTEXT_SIZE];
+  char json[LOGGING_CONTEXT_SIZE];
+} logging_context_t;
+
+static __thread logging_context_t g_context;
+
+/* Appends s as a JSON string, or returns NULL if it may not fit. */
+static char *json_quote(char *dest, const char *dest_end, const char *s)
+{
+  static const char k_hex[] = "0123456789abcdef";
+
+  if (dest_end - dest < 3)
+    return NULL;
+  *dest++ = '"';
+  for ( ; *s != '\0'; s++) {
+    unsigned char c = *s;
+    if (dest_end - dest < 8)  /* an escape, the quote and the NUL */
+      return NULL;
+    if (c == '"' || c == '\\') {
+      *dest++ = '\\';
+      *dest++ = c;
+    } else if (c < 0x20) {
+      *dest++ = '\\';
+      *dest++ = 'u';
+      *dest++ = '0';
+      *dest++ = '0';
+      *dest++ = k_hex[c >> 4];
+      *dest++ = k_hex[c & 15];
+    } else
+      *dest++ = c;
+  }
+  *dest++ = '"';
+  *dest = '\0';
+  return dest;
+}
+
+/* Appends ,"key":"value", or returns NULL if it may not fit. */
+static char *json_member(char *dest, const char *dest_end,
+                         const char *key, const char *value)
+{
+  if (dest_end - dest < 2)
+    return NULL;
+  *dest++ = ',';
+  if ((dest = json_quote(dest, dest_end, key)) == NULL ||
+      dest_end - dest < 2)
+    return NULL;
+  *dest++ = ':';
+  return json_quote(dest, dest_end, value);
+}
+
+int logging_context_push(const char *key, const char *value)
+{
+  logging_context_t *ctx = &g_context;
+  if (ctx->count == LOGGING_CONTEXT_MAX_DEPTH)
+    return -1;
+
+  size_t strings_len = ctx->count? ctx->strings_len[ctx->count - 1] : 0;
+  size_t rendered_len = ctx->count? ctx->rendered_len[ctx->count - 1] : 0;
+  size_t json_len = ctx->count? ctx->json_len[ctx->count - 1] : 0;
+
+  char *strings = ctx->strings + strings_len;
+  const char *strings_end = ctx->strings + sizeof(ctx->strings);
+  char *key_copy = strings;
+  char *value_copy = strxcpy(key_copy, strings_end, key, SIZE_MAX) + 1;
+  if (value_copy >= strings_end)
+    return -1;  /* possibly cut short */
+  char *p = strxcpy(value_copy, strings_end, value, SIZE_MAX) + 1;
+  if (p >= strings_end)
+    return -1;  /* possibly cut short */
+
+  strx_iovec_t iov[4] = {
+    { " ", 1 }, { key_copy, STRX_NTS }, { "=", 1 }, { value_copy, STRX_NTS },
+  };
+  char *rendered = ctx->rendered + rendered_len;
+  const char *rendered_end = ctx->rendered + sizeof(ctx->rendered);
+  size_t fit;
+  char *q = strxcpyv(rendered, rendered_end, iov + (ctx->count == 0),
+                     4 - (ctx->count == 0), &fit);
+  if (fit < (size_t) (4 - (ctx->count == 0))) {
+    *rendered = '\0';
+    return -1;
+  }
+
+  /* As extra members of a JSON object: ,"key":"value" */
+  char *json = ctx->json + json_len;
+  char *j = json_member(json, ctx->json + sizeof(ctx->json),
+                        key_copy, value_copy);
+  if (j == NULL) {
+    *rendered = '\0';
+    *json = '\0';
+    return -1;
+  }
+
+  ctx->pairs[ctx->count].key = key_copy;
+  ctx->pairs[ctx->count].value = value_copy;
+  ctx->strings_len[ctx->count] = p - ctx->strings;
+  ctx->rendered_len[ctx->count] = q - ctx->rendered;
+  ctx->json_len[ctx->count] = j - ctx->json;
+  ctx->count++;
+  return 0;
+}
+
+void logging_context_pop()
+{
+  logging_context_t *ctx = &g_context;
+  if (ctx->count == 0)
+    return;
+
+  ctx->count--;
+  ctx->rendered[ctx->count? ctx->rendered_len[ctx->count - 1] : 0] = '\0';
+  ctx->json[ctx->count? ctx->json_len[ctx->count - 1] : 0] = '\0';
+}
+
+/* Copies a context, with the pairs of the copy pointing into the copy. */
+static void logging_context_copy(logging_context_t *dst,
+                                 const logging_context_t *src)
+{
+  size_t strings_len = src->count? src->strings_len[src->count - 1] : 0;
+  size_t rendered_len = src->count? src->rendered_len[src->count - 1] : 0;
+  size_t json_len = src->count? src->json_len[src->count - 1] : 0;
+  int i;
+
+  for (i = 0; i < src->count; i++) {
+    dst->pairs[i].key = dst->strings + (src->pairs[i].key - src->strings);
+    dst->pairs[i].value = dst->strings + (src->pairs[i].value - src->strings);
+    dst->strings_len[i] = src->strings_len[i];
+    dst->rendered_len[i] = src->rendered_len[i];
+    dst->json_len[i] = src->json_len[i];
+  }
+  dst->count = src->count;
+  memcpy(dst->strings, src->strings, strings_len);
+  memcpy(dst->rendered, src->rendered, rendered_len);
+  dst->rendered[rendered_len] = '\0';
+  memcpy(dst->json, src->json, json_len);
+  dst->json[json_len] = '\0';
+}
+
+static void logging_dedup(logging_record_t *rec_p);
+
+/* Prepares everything but the message.  asctime_buf must outlive the
+ * record.
+ */
+static void logging_record_init(logging_record_t *rec_p,
+                                char *asctime_buf, size_t asctime_size,
+                                const logging_context_t *ctx,
+                                const char *pathname, int lineno,
+                                const char *func_name, int levelno)
 {
   logging_record_t r;
 
@@ -165,15 +656,13 @@ void logging_vprintf(const char *pathname, int lineno, const char *func_name,
   r.relative_created = (r.created - g_init_time) * 1000.0;
 
   /* Prepare asctime string. */
-  char asctime_buf[128];
-
   time_t t = time(NULL);
   struct tm tms;
   localtime_r(&t, &tms);
 
-  size_t res = strftime(asctime_buf, sizeof(asctime_buf), g_time_format, &tms);
-  if (res >= sizeof(asctime_buf))
-    res = sizeof(asctime_buf) - 1;
+  size_t res = strftime(asctime_buf, asctime_size, logging_time_format, &tms);
+  if (res >= asctime_size)
+    res = asctime_size - 1;
   asctime_buf[res] = '\0';
 
   r.asctime = asctime_buf;
@@ -187,15 +676,52 @@ void logging_vprintf(const char *pathname, int lineno, const char *func_name,
   r.thread_name = "UnknownThread";
   r.process = getpid();
 
+  /* Prepare the context, usually that of this thread. */
+  r.context = ctx->rendered;
+  r.context_len = ctx->count? ctx->rendered_len[ctx->count - 1] : 0;
+  r.context_json = ctx->json;
+  r.context_json_len = ctx->count? ctx->json_len[ctx->count - 1] : 0;
+  r.context_pairs = ctx->pairs;
+  r.context_count = ctx->count;
+
+  /* The message is left to the caller. */
+  r.msg = NULL;
+  r.message = NULL;
+  r.message_len = 0;
+
+  *rec_p = r;
+}
+
+static void logging_vrecord(int dedup, const logging_context_t *ctx,
+                            const char *pathname, int lineno,
+                            const char *func_name, int levelno,
+                            const char *msg, va_list ap)
+{
+  logging_record_t r;
+  char asctime_buf[128];
+
+  logging_record_init(&r, asctime_buf, sizeof(asctime_buf), ctx,
+                      pathname, lineno, func_name, levelno);
+
   /* Prepare logged message. */
   r.msg = msg;
   va_copy(r.ap, ap);
 
-  logging_emitter(&r);
+  if (dedup)
+    logging_dedup(&r);
+  else
+    logging_emitter(&r);
 
   va_end(r.ap);
 }
 
+void logging_vprintf(const char *pathname, int lineno, const char *func_name,
+                     int levelno, const char *msg, va_list ap)
+{
+  logging_vrecord(logging_dedup_timeout > 0.0, &g_context,
+                  pathname, lineno, func_name, levelno, msg, ap);
+}
+
 void logging_printf(const char *pathname, int lineno, const char *func_name,
                     int levelno, const char *fmt, ...)
 {
@@ -205,11 +731,275 @@ void logging_printf(const char *pathname, int lineno, const char *func_name,
   va_end(ap);
 }
 
+/* Repeated message suppression.  The message of each record is
+ * formatted up front and compared, together with the call site, the
+ * level and the context, against the previous record.  Repeats are
+ * counted rather than emitted, and summarized by a "last message
+ * repeated N times" record from the same call site and with the same
+ * context when a different record comes along,
+ * when the timeout expires, or at exit.  A flusher thread, started by
+ * the first record, takes care of the timeout.
+ *
+ * Decisions are made under g_dedup_lock, but records are emitted after
+ * releasing it, so a slow emitter does not hold up other threads.
+ */
+
+double logging_dedup_timeout = 0.0;
+
+#define DEDUP_MESSAGE_SIZE      1024
+
+static pthread_mutex_t g_dedup_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_dedup_repeated = PTHREAD_COND_INITIALIZER;
+static pthread_once_t g_dedup_once = PTHREAD_ONCE_INIT;
+
+static struct {
+  const char *pathname;
+  int lineno;
+  const char *func_name;
+  int levelno;
+  uint64_t hash;
+  size_t len;
+  char message[DEDUP_MESSAGE_SIZE];
+  logging_context_t context;
+  double since;                 /* when the last summary was emitted */
+  unsigned long repeats;
+} g_dedup;
+
+#define FNV1A_HASH_INIT         14695981039346656037ull
+
+static uint64_t fnv1a_hash(uint64_t h, const char *s, size_t len)
+{
+  size_t i;
+  for (i = 0; i < len; i++) {
+    h ^= (unsigned char) s[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/* A pending summary, taken out of g_dedup to be emitted unlocked. */
+typedef struct {
+  const char *pathname;
+  int lineno;
+  const char *func_name;
+  int levelno;
+  unsigned long repeats;
+  logging_context_t context;    /* only if repeats > 0 */
+} dedup_summary_t;
+
+static void logging_emit_repeated(const dedup_summary_t *s,
+                                  const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  logging_vrecord(0, &s->context, s->pathname, s->lineno, s->func_name,
+                  s->levelno, fmt, ap);
+  va_end(ap);
+}
+
+/* Must be called with g_dedup_lock held. */
+static void logging_dedup_take_locked(dedup_summary_t *s)
+{
+  s->pathname = g_dedup.pathname;
+  s->lineno = g_dedup.lineno;
+  s->func_name = g_dedup.func_name;
+  s->levelno = g_dedup.levelno;
+  s->repeats = g_dedup.repeats;
+  if (s->repeats > 0)
+    logging_context_copy(&s->context, &g_dedup.context);
+  g_dedup.repeats = 0;
+}
+
+static void logging_dedup_emit(const dedup_summary_t *s)
+{
+  if (s->repeats > 0)
+    logging_emit_repeated(s, "last message repeated %lu times", s->repeats);
+}
+
+void logging_dedup_flush()
+{
+  dedup_summary_t summary;
+
+  pthread_mutex_lock(&g_dedup_lock);
+  logging_dedup_take_locked(&summary);
+  pthread_mutex_unlock(&g_dedup_lock);
+
+  logging_dedup_emit(&summary);
+}
+
+static void *logging_dedup_flusher(void *arg)
+{
+  (void) arg;
+
+  pthread_mutex_lock(&g_dedup_lock);
+  for (;;) {
+    while (g_dedup.repeats == 0)
+      pthread_cond_wait(&g_dedup_repeated, &g_dedup_lock);
+
+    double now = gettimeofday_double();
+    double deadline = g_dedup.since + logging_dedup_timeout;
+    if (now < deadline) {
+      struct timespec ts;
+      ts.tv_sec = (time_t) deadline;
+      ts.tv_nsec = (long) ((deadline - (double) ts.tv_sec) * 1e9);
+      pthread_cond_timedwait(&g_dedup_repeated, &g_dedup_lock, &ts);
+      continue;
+    }
+
+    dedup_summary_t summary;
+    logging_dedup_take_locked(&summary);
+    g_dedup.since = now;
+    pthread_mutex_unlock(&g_dedup_lock);
+
+    logging_dedup_emit(&summary);
+
+    pthread_mutex_lock(&g_dedup_lock);
+  }
+
+  return NULL;
+}
+
+/* Runs once the first record is deduplicated, whether the timeout came
+ * from LOGGING_DEDUP_TIMEOUT or was set by the program.
+ */
+static void logging_dedup_start()
+{
+  pthread_t flusher;
+  if (pthread_create(&flusher, NULL, logging_dedup_flusher, NULL) == 0)
+    pthread_detach(flusher);
+  atexit(logging_dedup_flush);  /* runs before logging_flush() */
+}
+
+static void logging_dedup(logging_record_t *rec_p)
+{
+  char message[DEDUP_MESSAGE_SIZE];
+  strx_buf_t out;
+  va_list ap;
+
+  strx_buf_init(&out, message, sizeof(message));
+  if (rec_p->message)
+    strx_buf_putn(&out, rec_p->message, rec_p->message_len);
+  else {
+    va_copy(ap, rec_p->ap);
+    strx_buf_vprintf(&out, rec_p->msg, ap);
+    va_end(ap);
+  }
+
+  size_t len = strx_buf_len(&out);
+  uint64_t hash = fnv1a_hash(FNV1A_HASH_INIT, message, len);
+  hash = fnv1a_hash(hash, rec_p->context, rec_p->context_len);
+  dedup_summary_t summary;
+  int repeated = 0;
+
+  pthread_once(&g_dedup_once, logging_dedup_start);
+  pthread_mutex_lock(&g_dedup_lock);
+
+  if (strx_buf_truncated(&out)) {
+    /* Too long to remember; never treated as a repeat. */
+    logging_dedup_take_locked(&summary);
+    g_dedup.pathname = NULL;
+  }
+  else if (g_dedup.pathname == rec_p->pathname &&
+           g_dedup.lineno == rec_p->lineno &&
+           g_dedup.levelno == rec_p->levelno &&
+           g_dedup.hash == hash && g_dedup.len == len &&
+           memcmp(g_dedup.message, message, len) == 0 &&
+           g_dedup.context.count == rec_p->context_count &&
+           memcmp(g_dedup.context.rendered, rec_p->context,
+                  rec_p->context_len + 1) == 0) {
+    repeated = 1;
+    summary.repeats = 0;
+    if (++g_dedup.repeats == 1)
+      pthread_cond_signal(&g_dedup_repeated);
+    if (rec_p->created - g_dedup.since >= logging_dedup_timeout) {
+      logging_dedup_take_locked(&summary);
+      g_dedup.since = rec_p->created;
+    }
+  }
+  else {
+    logging_dedup_take_locked(&summary);
+    g_dedup.pathname = rec_p->pathname;
+    g_dedup.lineno = rec_p->lineno;
+    g_dedup.func_name = rec_p->func_name;
+    g_dedup.levelno = rec_p->levelno;
+    g_dedup.hash = hash;
+    g_dedup.len = len;
+    memcpy(g_dedup.message, message, len);
+    logging_context_copy(&g_dedup.context, &g_context);  /* the caller's */
+    g_dedup.since = rec_p->created;
+  }
+
+  pthread_mutex_unlock(&g_dedup_lock);
+
+  logging_dedup_emit(&summary);
+  if (repeated)
+    return;
+
+  if (!strx_buf_truncated(&out)) {
+    rec_p->message = message;
+    rec_p->message_len = len;
+  }
+  logging_emitter(rec_p);
+}
+
+/* Hands a record with its message already set to the emitter, with
+ * msg and ap set to "%s" and the message, for emitters that format
+ * msg themselves.
+ */
+static void logging_emit_message(logging_record_t *rec_p, const char *fmt, ...)
+{
+  rec_p->msg = fmt;
+  va_start(rec_p->ap, fmt);
+
+  if (logging_dedup_timeout > 0.0)
+    logging_dedup(rec_p);
+  else
+    logging_emitter(rec_p);
+
+  va_end(rec_p->ap);
+}
+
+void logging_raise_message(const char *file, int line, const char *func,
+                           int log_level, const char *message, size_t len)
+{
+  logging_ensure_initialized();
+  if (log_level < logging_log_level)
+    return;
+
+  logging_record_t r;
+  char asctime_buf[128];
+
+  logging_record_init(&r, asctime_buf, sizeof(asctime_buf), &g_context,
+                      file, line, func, log_level);
+
+  /* The message need not be NUL terminated, so msg gets a copy. */
+  char copy_buf[1024];
+  char *copy = copy_buf;
+  if (len >= sizeof(copy_buf)) {
+    if (len > LOGGING_MAX_MESSAGE_SIZE)
+      len = LOGGING_MAX_MESSAGE_SIZE;
+    copy = (char *) malloc(len + 1);
+    if (copy == NULL) {
+      copy = copy_buf;
+      len = sizeof(copy_buf) - 1;
+    }
+  }
+  memcpy(copy, message, len);
+  copy[len] = '\0';
+
+  r.message = copy;
+  r.message_len = len;
+  logging_emit_message(&r, "%s", copy);
+
+  if (copy != copy_buf)
+    free(copy);
+}
+
 void logging_raise(const char *file, int line, const char *func, int log_level,
                    const char *fmt, ...)
 {
   logging_ensure_initialized();
-  if (log_level < g_log_level)
+  if (log_level < logging_log_level)
     return;
 
   va_list ap;
@@ -30,6 +30,36 @@
  *   - LOGGING_TIME_FORMAT: a strftime() format string for displaying
  *     human readable time.
  *
+ *   - LOGGING_BUFFER_SIZE: if positive, records are buffered up to
+ *     this many bytes instead of written one by one.  The buffer is
+ *     flushed when full, for records of LOG_ERROR and above, by a
+ *     background thread once it holds a record older than a second,
+ *     and at exit.
+ *
+ *   - LOGGING_INDEX_INTERVAL: if positive and LOGGING_LOG_FILE is
+ *     set, a time index of the log file is kept in the same path plus
+ *     ".idx", with a checkpoint at most every this many seconds, see
+ *     logging_index_start().
+ *
+ *   - LOGGING_COMPRESS_BLOCK_SIZE: if positive, records are written
+ *     compressed in blocks of this many bytes, see logging_lz_start().
+ *
+ *   - LOGGING_CRASH_HANDLER: if non-zero, installs the fatal signal
+ *     handler, see logging_install_crash_handler().
+ *
+ *   - LOGGING_SHM_RING: the name of a shared memory ring created by
+ *     logging_shm_create() in another process.  Records are written
+ *     into the ring instead of to stdlog.
+ *
+ *   - LOGGING_SYSLOG: the path of a syslog socket, usually /dev/log.
+ *     Records are sent there instead of to stdlog, see
+ *     logging_syslog_open().
+ *
+ *   - LOGGING_DEDUP_TIMEOUT: if positive, identical messages logged
+ *     back to back from the same call site are suppressed, and
+ *     summarized as "last message repeated N times" when the message
+ *     changes or at most this many seconds later.
+ *
  * We also recognize the following per-compilation-unit compile-time
  * options:
  *
@@ -40,8 +70,16 @@
 #ifndef __LOGGING_H__
 #define __LOGGING_H__
 
+#include <signal.h>     /* sig_atomic_t */
 #include <stdio.h>      /* FILE */
 #include <stdarg.h>     /* va_list */
+#include <sys/types.h>  /* pid_t */
+
+#include "stringx.h"    /* strx_buf_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /**********************************************************************/
 /* Section: Typical Uses                                              */
@@ -121,8 +159,17 @@
  * http://docs.python.org/library/logging.html#formatter-objects
  * except that capitalized letters have been translated to lowercase
  * with a prepended underscore.
+ *
+ * Emitters should prefer message and message_len when message is not
+ * NULL, rather than formatting msg with ap again; ap can be consumed
+ * only once, and the message may already be formatted elsewhere.
  */
 
+typedef struct {
+  const char *key;
+  const char *value;
+} logging_context_pair_t;
+
 typedef struct logging_record_s {
   const char *name;
   int levelno;
@@ -140,6 +187,14 @@ typedef struct logging_record_s {
   int process;
   const char *msg;
   va_list ap;
+  const char *message;  /* msg formatted with ap if not NULL */
+  size_t message_len;
+  const char *context;  /* rendered context, see logging_context_push() */
+  size_t context_len;
+  const char *context_json;  /* the same as extra JSON object members */
+  size_t context_json_len;
+  const logging_context_pair_t *context_pairs;  /* outermost first */
+  int context_count;
 } logging_record_t;
 
 /* By default, the log emitter formats the log entry according to the
@@ -165,15 +220,212 @@ extern int logging_log_level;
 extern const char *logging_log_format;
 extern const char *logging_time_format;
 
+/* Repeated message suppression, see LOGGING_DEDUP_TIMEOUT above.  The
+ * pending "repeated" summary, if any, is emitted by a background thread
+ * once the timeout expires, at exit, or by calling logging_dedup_flush().
+ */
+
+extern double logging_dedup_timeout;
+
+void logging_dedup_flush();
+
+/* Per-thread context.  logging_context_push() pushes a key and value,
+ * both copied, onto the context stack of the calling thread, and
+ * logging_context_pop() removes the latest one.  The stack is rendered
+ * as "key=value key=value" once per push, so that "%(context)s" in the
+ * log format costs a single copy per record.  It is also rendered as
+ * ,"key":"value",... with JSON escapes, for "%(context_json)s" to add
+ * the pairs as extra keys to a JSON object, as in
+ *
+ *   {"message": "%(message)s"%(context_json)s}
+ *
+ * Emitters of other structured output can use the pairs in the record.
+ *
+ * The stack holds up to LOGGING_CONTEXT_MAX_DEPTH pairs, and up to
+ * LOGGING_CONTEXT_SIZE bytes of keys and values, as well as of each
+ * rendering.  logging_context_push() returns -1 if the pair does not
+ * fit, in which case it must not be popped.
+ */
+
+#define LOGGING_CONTEXT_MAX_DEPTH       16
+#define LOGGING_CONTEXT_SIZE            1024
+
+int logging_context_push(const char *key, const char *value);
+void logging_context_pop();
+
+/* Writes out buffered records, see LOGGING_BUFFER_SIZE above. */
+
+void logging_flush();
+
+/* Installs handlers for SIGSEGV, SIGABRT and SIGBUS that write out
+ * buffered records and a final CRIT record naming the signal, using
+ * async-signal-safe calls only, and then re-raise the signal.  This
+ * makes buffered output safe to use in programs that may crash.  The
+ * records go to the file descriptor of stdlog at the time of the call.
+ */
+
+void logging_install_crash_handler();
+
+/* Multi-process logging through a shared memory ring.  Typical use in
+ * a pre-forking server:
+ *
+ *   logging_ensure_initialized();
+ *   logging_shm_create(NULL, 4096, 512);
+ *   logging_shm_spawn_collector(fileno(stdlog));
+ *   ... fork() workers ...
+ *
+ * logging_shm_create() creates a ring of num_slots records of at most
+ * slot_size bytes each (including a 16 byte header), in an anonymous
+ * memfd if name is NULL, or in a named POSIX shared memory object
+ * that unrelated processes can logging_shm_attach() to, e.g. through
+ * LOGGING_SHM_RING.  Both make logging_emit_shm() the emitter.  A
+ * named ring is never reinitialized: logging_shm_create() fails with
+ * EEXIST if the name is taken.  The name stays until the creator
+ * calls logging_shm_unlink(), which does not affect attached processes.
+ * logging_shm_attach() fails with EINVAL if the object is not a ring,
+ * or if its slots do not fit in it.  Records that do not fit in a slot
+ * are truncated; records that do not fit in a full ring are dropped
+ * and counted per process.
+ *
+ * A single collector drains the ring in order to fd, along with
+ * notices about dropped records and records lost to workers that
+ * crashed mid-write.  logging_shm_spawn_collector() forks a collector
+ * process that runs until SIGTERM or until its parent exits;
+ * logging_shm_collect() runs the collector loop in the calling thread
+ * until *stop_p becomes non-zero.  logging_shm_drain() is a single
+ * non-blocking pass that returns the number of records written.
+ *
+ * logging_shm_drops() returns the number of records dropped by a
+ * process so far, or by all processes if pid is 0.
+ */
+
+#define LOGGING_SHM_MAX_SLOT_SIZE       4096
+
+int logging_shm_create(const char *name, size_t num_slots, size_t slot_size);
+int logging_shm_attach(const char *name);
+int logging_shm_unlink(const char *name);
+void logging_emit_shm(logging_record_t *rec_p);
+pid_t logging_shm_spawn_collector(int fd);
+int logging_shm_collect(int fd, volatile sig_atomic_t *stop_p);
+size_t logging_shm_drain(int fd);
+unsigned long long logging_shm_drops(pid_t pid);
+
+/* Time index of the log file.  logging_index_start() appends to the
+ * index file a checkpoint of the time and byte offset of the next record
+ * at most every interval seconds.  logging_query uses the index to find
+ * a time range in the log file without reading all of it.  Only works
+ * with logging_emit_stdlog() writing to a regular file, and with a log
+ * format that starts with %(asctime)s, since logging_query reads the
+ * time of records from the start of their lines; otherwise fails with
+ * EINVAL.
+ *
+ * The index file starts with LOGGING_INDEX_MAGIC, followed by the
+ * checkpoints in native byte order, ordered by both time and offset.
+ */
+
+#define LOGGING_INDEX_MAGIC             "LOGIDX1\n"
+
+typedef struct {
+  int64_t usec;         /* created, in microseconds since the epoch */
+  uint64_t offset;      /* of the first record at or after usec */
+} logging_index_entry_t;
+
+int logging_index_start(const char *pathname, double interval);
+
+/* Compressed output.  logging_lz_start() makes logging_emit_lz() the
+ * emitter, which gathers records into blocks of up to block_size bytes.
+ * A writer thread compresses each block on its own and writes it to fd,
+ * when the block is full, when its first record is over a second old,
+ * and at exit or logging_lz_flush().  Since blocks are independent,
+ * a crash loses at most the blocks not yet written, and none of them
+ * if the fatal signal handler is installed.  logging_unlz decompresses
+ * the output.
+ *
+ * logging_lz_compress() compresses n bytes into dest, which must have
+ * room for logging_lz_bound(n) bytes, and returns the compressed size.
+ * logging_lz_decompress() returns the decompressed size, or -1 if the
+ * data is corrupt or does not fit in dest_size bytes.
+ * logging_lz_checksum() continues the frame checksum of sum, starting
+ * from LOGGING_LZ_CHECKSUM_INIT, over n more bytes.
+ *
+ * logging_lz_crash_drain() writes out the blocks not yet written as
+ * stored blocks, the last one with final appended, using
+ * async-signal-safe calls only.  The fatal signal handler calls it.
+ * Returns -1 if compressed output is not in use.
+ */
+
+#define LOGGING_LZ_MAGIC                "LZBK"
+#define LOGGING_LZ_HEADER_SIZE          16
+#define LOGGING_LZ_MAX_BLOCK_SIZE       (16 << 20)
+#define LOGGING_LZ_CHECKSUM_INIT        2166136261u
+
+int logging_lz_start(int fd, size_t block_size);
+void logging_emit_lz(logging_record_t *rec_p);
+void logging_lz_flush();
+size_t logging_lz_bound(size_t n);
+size_t logging_lz_compress(void *dest, const void *src, size_t n);
+ssize_t logging_lz_decompress(void *dest, size_t dest_size,
+                              const void *src, size_t n);
+uint32_t logging_lz_checksum(uint32_t sum, const void *data, size_t n);
+int logging_lz_crash_drain(const char *final, size_t len);
+
+/* Syslog output.  logging_syslog_open() connects to the Unix datagram
+ * socket at path (/dev/log if NULL) and makes logging_emit_syslog() the
+ * emitter.  Records are sent as RFC 5424 messages of the user facility,
+ * with the severity mapped from levelno, and app_name (the program name
+ * if NULL) as APP-NAME.  logging_syslog_format is the log format of MSG.
+ *
+ * A sender thread sends queued messages in batches with sendmmsg(), and
+ * reconnects if the receiver restarts.  If the receiver falls behind,
+ * up to 1024 messages are queued; beyond that messages are dropped,
+ * counted by logging_syslog_drops(), and reported to the receiver when
+ * it catches up.  logging_syslog_flush() waits up to a second for the
+ * queue to drain, and is also called at exit.
+ *
+ * logging_syslog_crash_drain() sends whatever is queued, then final as
+ * a CRIT message, using async-signal-safe calls only.  It sends without
+ * blocking, and gives a receiver that falls behind up to a second in
+ * all.  Returns -1 if syslog output is not in use or the receiver
+ * cannot be reached.
+ */
+
+extern const char *logging_syslog_format;
+
+int logging_syslog_open(const char *path, const char *app_name);
+void logging_emit_syslog(logging_record_t *rec_p);
+void logging_syslog_flush();
+unsigned long long logging_syslog_drops();
+int logging_syslog_crash_drain(const char *final, size_t len);
+
 /* Functions that most users don't really need to know. */
 
 void logging_ensure_initialized();
 void logging_raise(const char *file, int line, const char *func, int log_level,
                    const char *fmt, ...);
 void logging_emit_stdlog(logging_record_t *rec_p);
+
+/* Like logging_raise(), but with the message already formatted, of len
+ * bytes that need not be NUL terminated.  Messages formatted elsewhere,
+ * such as by logging.hpp, should be at most LOGGING_MAX_MESSAGE_SIZE,
+ * and are truncated beyond it.  The record gets a NUL terminated copy
+ * as message, with msg and ap set to "%s" and the copy.
+ */
+
+#define LOGGING_MAX_MESSAGE_SIZE        65536
+
+void logging_raise_message(const char *file, int line, const char *func,
+                           int log_level, const char *message, size_t len);
+
 size_t logging_formatter(logging_record_t *rec_p, const char *log_fmt,
                          char *buf, size_t buf_size);
 
+/* Like logging_formatter(), but appends to a string buffer builder.
+ * If the record did not fit, strx_buf_truncated(out) is set, and the
+ * record can be formatted again into a larger buffer.
+ */
+void logging_format_record(logging_record_t *rec_p, const char *log_fmt,
+                           strx_buf_t *out);
+
 /**********************************************************************/
 /* Section: Internal Use Only                                         */
 /**********************************************************************/
@@ -195,4 +447,8 @@ size_t logging_formatter(logging_record_t *rec_p, const char *log_fmt,
 #  endif
 #endif
 
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
 #endif  /* __LOGGING_H__ */
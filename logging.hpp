@@ -0,0 +1,102 @@
+/* Logging facility, C++ interface.
+ * Copyright (C) 2009, 2010  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Include this instead of logging.h in C++ translation units.  The
+ * LOG() family of macros then format the message with strx::sxprintf()
+ * from stringx.hpp, so the format string is parsed and the arguments
+ * are type checked at compile time.  The format must be a string
+ * literal.  Everything else is shared with the C interface.
+ */
+
+#ifndef __LOGGING_HPP__
+#define __LOGGING_HPP__
+
+#include <memory>   /* std::unique_ptr */
+#include <new>      /* std::nothrow */
+
+#include "logging.h"
+#include "stringx.hpp"
+
+namespace logging {
+
+template <class Fmt, class... Args>
+inline void raise(const char *file, int line, const char *func, int log_level,
+                  Fmt fmt, const Args &... args) {
+  logging_ensure_initialized();
+  if (log_level < logging_log_level)
+    return;
+
+  /* Like logging_raise(), retry long messages in a larger buffer. */
+  char buf[1024];
+  strx_buf_t b;
+  strx_buf_init(&b, buf, sizeof(buf));
+  strx::buf_printf(&b, fmt, args...);
+
+  std::unique_ptr<char[]> big;
+  if (strx_buf_truncated(&b)) {
+    big.reset(new (std::nothrow) char[LOGGING_MAX_MESSAGE_SIZE]);
+    if (big) {
+      strx_buf_init(&b, big.get(), LOGGING_MAX_MESSAGE_SIZE);
+      strx::buf_printf(&b, fmt, args...);
+    }
+  }
+
+  logging_raise_message(file, line, func, log_level, b.base,
+                        strx_buf_len(&b));
+}
+
+/* Pushes a context pair for the lifetime of the object, see
+ * logging_context_push().
+ *
+ *   logging::context_scope request("request", request_id);
+ */
+class context_scope {
+ public:
+  context_scope(const char *key, const char *value)
+      : pushed_(logging_context_push(key, value) == 0) {}
+  ~context_scope() {
+    if (pushed_)
+      logging_context_pop();
+  }
+
+  context_scope(const context_scope &) = delete;
+  context_scope &operator=(const context_scope &) = delete;
+
+ private:
+  bool pushed_;
+};
+
+}  /* namespace logging */
+
+#undef LOG
+#undef LOG_IF
+
+#if defined(_DISABLE_LOGGING) || defined(ISABLE_LOGGING)
+#  define LOG(level, fmt, args...)
+#else
+#  define LOG(level, fmt, args...) \
+     logging::raise(__FILE__, __LINE__, __func__, level, STRX_FMT(fmt), ##args)
+#endif  /* _DISABLE_LOGGING || ISABLE_LOGGING */
+
+#define LOG_IF(cond, level, fmt, args...)                               \
+  do {                                                                  \
+    if (cond)                                                           \
+      logging::raise(__FILE__, __LINE__, __func__, level,               \
+                     STRX_FMT(fmt), ##args);                            \
+  } while(0)
+
+#endif  /* __LOGGING_HPP__ */
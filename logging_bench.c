@@ -0,0 +1,185 @@
+/* Logging facility end-to-end benchmark.
+ * Copyright (C) 2009, 2010  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Runs a number of producer threads that each call INFO() or DEBUG()
+ * in a tight loop, and reports the throughput and per-call latency
+ * percentiles.  Usage:
+ *
+ *   logging_bench [-t threads] [-n calls per thread] [-s message size]
+ *                 [-r pass ratio] [-o output file] [-f log format]
+ *                 [-l label]
+ *
+ * The pass ratio is the fraction of calls that make it past the log
+ * level filter; the rest are DEBUG() calls that are filtered out.
+ * Output file and log format default to LOGGING_LOG_FILE and
+ * LOGGING_LOG_FORMAT.  See logging_bench_wrapper.sh for the full
+ * benchmark matrix.
+ */
+
+#define _POSIX_C_SOURCE 200112L  /* clock_gettime(), pthread_barrier_t */
+
+#include "logging.h"
+
+#include <pthread.h>    /* pthread_create(), pthread_barrier_wait() */
+#include <stdint.h>     /* uint32_t, UINT32_MAX */
+#include <stdio.h>      /* printf(), fprintf() */
+#include <stdlib.h>     /* malloc(), qsort(), setenv(), strtol() */
+#include <string.h>     /* memset() */
+#include <time.h>       /* clock_gettime() */
+#include <unistd.h>     /* getopt() */
+
+typedef struct {
+  pthread_t tid;
+  long calls;
+  double pass_ratio;
+  const char *payload;
+  long emitted;
+  uint32_t *latency_ns;
+} producer_t;
+
+static pthread_barrier_t g_start;
+
+static inline uint64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void *producer_main(void *arg)
+{
+  producer_t *p = (producer_t *) arg;
+  double acc = 0.0;
+  long i;
+
+  pthread_barrier_wait(&g_start);
+
+  for (i = 0; i < p->calls; i++) {
+    uint64_t t0 = now_ns();
+
+    acc += p->pass_ratio;
+    if (acc >= 1.0) {
+      acc -= 1.0;
+      INFO("i = %d %s", (int) i, p->payload);
+      p->emitted++;
+    } else
+      DEBUG("i = %d %s", (int) i, p->payload);
+
+    uint64_t dt = now_ns() - t0;
+    p->latency_ns[i] = (dt > UINT32_MAX)? UINT32_MAX : (uint32_t) dt;
+  }
+
+  return NULL;
+}
+
+static int compare_uint32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, double q)
+{
+  size_t k = (size_t) (q * (double) n);
+  return sorted[(k < n)? k : n - 1];
+}
+
+int main(int argc, char **argv)
+{
+  int num_threads = 1;
+  long calls = 100000;
+  size_t msg_size = 64;
+  double pass_ratio = 1.0;
+  const char *label = "C";
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:n:s:r:o:f:l:")) != -1) {
+    switch (opt) {
+    case 't': num_threads = strtol(optarg, NULL, 10); break;
+    case 'n': calls = strtol(optarg, NULL, 10); break;
+    case 's': msg_size = strtol(optarg, NULL, 10); break;
+    case 'r': pass_ratio = strtod(optarg, NULL); break;
+    case 'o': setenv("LOGGING_LOG_FILE", optarg, 1); break;
+    case 'f': setenv("LOGGING_LOG_FORMAT", optarg, 1); break;
+    case 'l': label = optarg; break;
+    default:
+      fprintf(stderr, "usage: %s [-t threads] [-n calls] [-s msg_size] "
+              "[-r pass_ratio] [-o file] [-f format] [-l label]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if (num_threads < 1 || calls < 1) {
+    fprintf(stderr, "%s: need at least one thread and one call\n", argv[0]);
+    return 2;
+  }
+
+  /* Filter out DEBUG() but keep INFO(), unless overridden. */
+  setenv("LOGGING_LOG_LEVEL", "20", 0);
+  logging_ensure_initialized();
+
+  char *payload = malloc(msg_size + 1);
+  producer_t *producers = calloc(num_threads, sizeof(producer_t));
+  uint32_t *samples = malloc(sizeof(uint32_t) * calls * num_threads);
+  if (!payload || !producers || !samples) {
+    perror(argv[0]);
+    return 1;
+  }
+
+  memset(payload, 'x', msg_size);
+  payload[msg_size] = '\0';
+
+  pthread_barrier_init(&g_start, NULL, num_threads + 1);
+
+  int i;
+  for (i = 0; i < num_threads; i++) {
+    producer_t *p = &producers[i];
+    p->calls = calls;
+    p->pass_ratio = pass_ratio;
+    p->payload = payload;
+    p->latency_ns = samples + (size_t) i * calls;
+    pthread_create(&p->tid, NULL, producer_main, p);
+  }
+
+  pthread_barrier_wait(&g_start);
+  uint64_t t0 = now_ns();
+
+  long emitted = 0;
+  for (i = 0; i < num_threads; i++) {
+    pthread_join(producers[i].tid, NULL);
+    emitted += producers[i].emitted;
+  }
+
+  double elapsed = (now_ns() - t0) * 1e-9;
+  size_t total = (size_t) calls * num_threads;
+  qsort(samples, total, sizeof(uint32_t), compare_uint32);
+
+  printf("%-8s threads=%-3d size=%-5zu pass=%.2f "
+         "calls/s=%-10.0f records/s=%-10.0f "
+         "p50=%uns p99=%uns p999=%uns\n",
+         label, num_threads, msg_size, pass_ratio,
+         total / elapsed, emitted / elapsed,
+         percentile(samples, total, 0.50),
+         percentile(samples, total, 0.99),
+         percentile(samples, total, 0.999));
+
+  pthread_barrier_destroy(&g_start);
+  free(samples);
+  free(producers);
+  free(payload);
+  return 0;
+}
@@ -0,0 +1,51 @@
+#!/bin/bash
+#
+# Runs logging_bench over a matrix of thread counts, message sizes,
+# level filter ratios, log formats and output targets, with the Python
+# logging module from logging_py_test.py as a comparison point.  The
+# matrix can be narrowed down through the environment, e.g.
+#
+#   THREADS="1 8" SIZES=64 CALLS=1000000 ./logging_bench_wrapper.sh
+
+function make_format {
+  cat $1 | awk '{print "%(" $_ ")s"}' | xargs echo
+}
+
+[ ! -x ./logging_bench ] && make logging_bench
+
+THREADS=${THREADS:-"1 4"}
+SIZES=${SIZES:-"16 256"}
+RATIOS=${RATIOS:-"1.0 0.1"}
+CALLS=${CALLS:-100000}
+PY_CALLS=${PY_CALLS:-$((CALLS / 10))}
+TMPFS_DIR=${TMPFS_DIR:-/dev/shm}
+PYTHON=${PYTHON:-python}
+
+SHORT_FORMAT="%(asctime)s - %(levelname)s - %(message)s"
+FULL_FORMAT=`make_format logging_variables.txt`
+
+TARGETS="/dev/null $TMPFS_DIR/logging_bench.$$.log ./logging_bench.$$.log"
+
+for target in $TARGETS; do
+  for format_name in short full; do
+    if [ $format_name = short ]; then
+      format=$SHORT_FORMAT
+    else
+      format=$FULL_FORMAT
+    fi
+
+    echo "# target=$target format=$format_name"
+    for threads in $THREADS; do
+      for size in $SIZES; do
+        for ratio in $RATIOS; do
+          ./logging_bench -l C -t $threads -n $CALLS -s $size -r $ratio \
+            -o "$target" -f "$format"
+          $PYTHON logging_py_test.py -b -l Python \
+            -t $threads -n $PY_CALLS -s $size -r $ratio \
+            -o "$target" -f "$format"
+        done
+      done
+    done
+    [ "$target" != /dev/null ] && rm -f "$target"
+  done
+done
@@ -0,0 +1,25 @@
+#include "logging.hpp"
+
+#include <string>
+
+int main()
+{
+  int i;
+  for (i = 0; i < 5; i++)
+    INFO("i = %d", i);
+
+  DEBUG_EXPR("%d", i);
+
+  std::string s = "string";
+  INFO("%s %u %x %c %.3f %p %%", s, 42u, 255, 'c', 3.14159, (void *) &i);
+
+  {
+    logging::context_scope request("request", "r-1");
+    INFO("in context");
+  }
+
+  std::string long_message(2000, 'x');
+  INFO("%s end", long_message);
+
+  return 0;
+}
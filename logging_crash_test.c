@@ -0,0 +1,92 @@
+#include "logging.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NUM_RECORDS     100
+
+static char g_log_file[64];
+
+/* Logs through a buffer with the crash handler installed, half of the
+ * records long enough before the crash for the flusher to write them
+ * out, and then dies of signo.
+ */
+static void crasher_main(int signo)
+{
+  setenv("LOGGING_LOG_FILE", g_log_file, 1);
+  setenv("LOGGING_BUFFER_SIZE", "65536", 1);
+  setenv("LOGGING_CRASH_HANDLER", "1", 1);
+  unsetenv("LOGGING_COMPRESS_BLOCK_SIZE");
+  unsetenv("LOGGING_SHM_RING");
+  unsetenv("LOGGING_SYSLOG");
+
+  int i;
+  for (i = 0; i < NUM_RECORDS; i++) {
+    INFO("record %d", i);
+    if (i == NUM_RECORDS / 2)
+      usleep(1500000);
+  }
+
+  if (signo == SIGSEGV) {
+    int *volatile p = NULL;
+    *p = 1;
+  }
+  raise(signo);
+}
+
+/* Checks that every record and then the CRIT record reached the file,
+ * each exactly once.
+ */
+static int crash(int signo, const char *name)
+{
+  snprintf(g_log_file, sizeof(g_log_file),
+           "/tmp/logging_crash_test.%d", (int) getpid());
+  unlink(g_log_file);
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    crasher_main(signo);
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  int failures = !WIFSIGNALED(status) || WTERMSIG(status) != signo;
+
+  FILE *f = fopen(g_log_file, "r");
+  char line[256], crit[64];
+  int next = 0, records = 0, crits = 0, i;
+  snprintf(crit, sizeof(crit), "CRIT - process %d caught %s", (int) pid, name);
+  while (f && fgets(line, sizeof(line), f) != NULL) {
+    const char *s = strstr(line, "record ");
+    if (s && sscanf(s, "record %d", &i) == 1 && crits == 0) {
+      failures += i != next;
+      next = i + 1;
+      records++;
+    } else if (strstr(line, crit) != NULL)
+      crits++;
+    else
+      failures++;
+  }
+  if (f)
+    fclose(f);
+  unlink(g_log_file);
+
+  printf("%s: %d of %d records, %d CRIT\n", name, records, NUM_RECORDS, crits);
+  return failures + (records != NUM_RECORDS) + (crits != 1);
+}
+
+int main()
+{
+  int failures = 0;
+
+  failures += crash(SIGABRT, "SIGABRT");
+  failures += crash(SIGSEGV, "SIGSEGV");
+
+  printf("%s\n", failures? "FAIL" : "PASS");
+  return failures != 0;
+}
@@ -0,0 +1,97 @@
+#include "logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DEDUP_TIMEOUT   0.5     /* seconds */
+
+static char g_log_file[64];
+
+static void say(const char *msg)
+{
+  INFO("%s", msg);
+}
+
+/* The summary comes out when the message changes. */
+static void changed_main()
+{
+  say("a");
+  say("a");
+  say("a");
+  say("b");
+  _exit(0);
+}
+
+/* The summary comes out once the timeout expires, with no further
+ * records; _exit() skips the summary at exit.
+ */
+static void timer_main()
+{
+  say("c");
+  say("c");
+  say("c");
+  usleep(DEDUP_TIMEOUT * 3 * 1e6);
+  _exit(0);
+}
+
+/* The summary comes out at exit. */
+static void exit_main()
+{
+  say("d");
+  say("d");
+  say("d");
+  exit(0);
+}
+
+/* Runs child_main with deduplication turned on by the program rather
+ * than by LOGGING_DEDUP_TIMEOUT, and checks what it logged.
+ */
+static int dedup(const char *name, void (*child_main)(), const char *expected)
+{
+  snprintf(g_log_file, sizeof(g_log_file),
+           "/tmp/logging_dedup_test.%d", (int) getpid());
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    logging_ensure_initialized();
+    stdlog = fopen(g_log_file, "w");
+    setbuf(stdlog, NULL);
+    logging_log_format = "%(message)s";
+    logging_dedup_timeout = DEDUP_TIMEOUT;
+    child_main();
+  }
+  waitpid(pid, NULL, 0);
+
+  char got[1024];
+  FILE *f = fopen(g_log_file, "r");
+  size_t n = f? fread(got, 1, sizeof(got) - 1, f) : 0;
+  got[n] = '\0';
+  if (f)
+    fclose(f);
+  unlink(g_log_file);
+
+  int failed = strcmp(got, expected) != 0;
+  printf("%s: %s\n", name, failed? "FAILED" : "ok");
+  if (failed)
+    printf("got:\n%sexpected:\n%s", got, expected);
+  return failed;
+}
+
+int main()
+{
+  int failures = 0;
+
+  failures += dedup("changed", changed_main,
+                    "a\nlast message repeated 2 times\nb\n");
+  failures += dedup("timer", timer_main,
+                    "c\nlast message repeated 2 times\n");
+  failures += dedup("exit", exit_main,
+                    "d\nlast message repeated 2 times\n");
+
+  printf("%s\n", failures? "FAIL" : "PASS");
+  return failures != 0;
+}
@@ -16,12 +16,69 @@
  */
 
 #include "logging.h"
+#include "logging_internal.h"
 
+#include <errno.h>      /* errno, EINTR */
+#include <stdarg.h>     /* va_list, va_copy(), va_end() */
 #include <string.h>
+#include <unistd.h>     /* write() */
 #include "stringx.h"
 
-static char *
-logging_append_info(char *dest, const char *dest_end,
+/* The formatter collects literal spans of the format string and the
+ * record fields as pieces, and copies them to the output buffer in
+ * batches with strxcpyv().  Numeric fields are rendered into a small
+ * scratch area first, so that they can be batched as well.
+ */
+
+#define MAX_PIECES      32
+#define SCRATCH_SIZE    256
+#define SCRATCH_RESERVE 64      /* enough for any one numeric field */
+
+typedef struct {
+  strx_buf_t *out;
+  strx_iovec_t iov[MAX_PIECES];
+  size_t iovcnt;
+  char scratch[SCRATCH_SIZE];
+  char *scratch_p;
+} logging_format_state_t;
+
+static void logging_flush_pieces(logging_format_state_t *st)
+{
+  strx_buf_putv(st->out, st->iov, st->iovcnt);
+  st->iovcnt = 0;
+  st->scratch_p = st->scratch;
+}
+
+static void logging_add_piece(logging_format_state_t *st,
+                              const char *base, size_t len)
+{
+  if (st->iovcnt == MAX_PIECES)
+    logging_flush_pieces(st);
+  st->iov[st->iovcnt].base = base;
+  st->iov[st->iovcnt].len = len;
+  st->iovcnt++;
+}
+
+static char *logging_scratch(logging_format_state_t *st)
+{
+  if (st->scratch + SCRATCH_SIZE - st->scratch_p < SCRATCH_RESERVE)
+    logging_flush_pieces(st);
+  return st->scratch_p;
+}
+
+static void logging_add_scratch(logging_format_state_t *st, char *end)
+{
+  logging_add_piece(st, st->scratch_p, end - st->scratch_p);
+  st->scratch_p = end + 1;  /* skip the NUL terminator */
+}
+
+#define SCRATCH_PRINTF(st, fmt, args...)                                \
+  logging_add_scratch(st, sxprintf(logging_scratch(st),                 \
+                                   (st)->scratch + SCRATCH_SIZE,        \
+                                   fmt, ##args))
+
+static void
+logging_append_info(logging_format_state_t *st,
                     logging_record_t *rec_p, const char *key, int key_len)
 {
   /* Verify this list against the output of:
@@ -34,65 +91,81 @@ logging_append_info(char *dest, const char *dest_end,
    * using binary search.
    */
 
-  size_t buf_size = dest_end - dest;
-
   switch (key_len) {
   case 4:
     if (strncmp(key, "name", key_len) == 0)
-      dest = strxcpy(dest, dest_end, rec_p->name, buf_size);
+      logging_add_piece(st, rec_p->name, STRX_NTS);
     break;
 
   case 5:
     if (strncmp(key, "msecs", key_len) == 0)
-      dest = sxprintf(dest, dest_end, "%03d", rec_p->msecs);
+      SCRATCH_PRINTF(st, "%03d", rec_p->msecs);
     break;
 
   case 6:
     if (strncmp(key, "lineno", key_len) == 0)
-      dest = sxprintf(dest, dest_end, "%d", rec_p->lineno);
+      SCRATCH_PRINTF(st, "%d", rec_p->lineno);
     else if (strncmp(key, "thread", key_len) == 0)
-      dest = sxprintf(dest, dest_end, "%lu", rec_p->thread);
+      SCRATCH_PRINTF(st, "%lu", rec_p->thread);
     break;
 
   case 7:
     if (strncmp(key, "levelno", key_len) == 0)
-      dest = sxprintf(dest, dest_end, "%d", rec_p->levelno);
+      SCRATCH_PRINTF(st, "%d", rec_p->levelno);
     else if (strncmp(key, "created", key_len) == 0)
-      dest = sxprintf(dest, dest_end, "%f", rec_p->created);
+      SCRATCH_PRINTF(st, "%f", rec_p->created);
     else if (strncmp(key, "asctime", key_len) == 0)
-      dest = strxcpy(dest, dest_end, rec_p->asctime, buf_size);
+      logging_add_piece(st, rec_p->asctime, STRX_NTS);
     else if (strncmp(key, "process", key_len) == 0)
-      dest = sxprintf(dest, dest_end, "%d", rec_p->process);
-    else if (strncmp(key, "message", key_len) == 0)
-      dest = vsxprintf(dest, dest_end, rec_p->msg, rec_p->ap);
+      SCRATCH_PRINTF(st, "%d", rec_p->process);
+    else if (strncmp(key, "context", key_len) == 0)
+      logging_add_piece(st, rec_p->context, rec_p->context_len);
+    else if (strncmp(key, "message", key_len) == 0 && rec_p->message) {
+      logging_flush_pieces(st);
+      strx_buf_putn(st->out, rec_p->message, rec_p->message_len);
+    }
+    else if (strncmp(key, "message", key_len) == 0) {
+      /* The message is formatted straight into the output buffer.
+       * Use a copy of the argument pointer so that the record can be
+       * formatted again should the output buffer be too small.
+       */
+      va_list ap;
+      va_copy(ap, rec_p->ap);
+      logging_flush_pieces(st);
+      strx_buf_vprintf(st->out, rec_p->msg, ap);
+      va_end(ap);
+    }
     break;
 
   case 8:
     if (strncmp(key, "pathname", key_len) == 0)
-      dest = strxcpy(dest, dest_end, rec_p->pathname, buf_size);
+      logging_add_piece(st, rec_p->pathname, STRX_NTS);
     else if (strncmp(key, "filename", key_len) == 0)
-      dest = strxcpy(dest, dest_end, rec_p->filename, buf_size);
+      logging_add_piece(st, rec_p->filename, STRX_NTS);
     else if (strncmp(key, "funcName", key_len) == 0)
-      dest = strxcpy(dest, dest_end, rec_p->func_name, buf_size);
+      logging_add_piece(st, rec_p->func_name, STRX_NTS);
     break;
 
   case 9:
     if (strncmp(key, "levelname", key_len) == 0)
-      dest = strxcpy(dest, dest_end, rec_p->levelname, buf_size);
+      logging_add_piece(st, rec_p->levelname, STRX_NTS);
     break;
 
   case 10:
     if (strncmp(key, "threadName", key_len) == 0)
-      dest = strxcpy(dest, dest_end, rec_p->thread_name, buf_size);
+      logging_add_piece(st, rec_p->thread_name, STRX_NTS);
+    break;
+
+  case 12:
+    if (strncmp(key, "context_json", key_len) == 0)
+      logging_add_piece(st, rec_p->context_json, rec_p->context_json_len);
     break;
 
   case 15:
     if (strncmp(key, "relativeCreated", key_len) == 0)
-      dest = sxprintf(dest, dest_end, "%f", rec_p->relative_created);
+      SCRATCH_PRINTF(st, "%f", rec_p->relative_created);
     break;
   }
-
-  return dest;
 }
 
 static char *strchrnul(const char *s, int c) {
@@ -102,21 +175,18 @@ static char *strchrnul(const char *s, int c) {
   return (char *) s;
 }
 
-size_t logging_formatter(logging_record_t *rec_p, const char *log_fmt,
-                         char *buf, size_t buf_size)
+void logging_format_record(logging_record_t *rec_p, const char *log_fmt,
+                           strx_buf_t *out)
 {
-  /* In the format parser below, we also use buf_size liberally as a
-   * lose upper bound for number of bytes to copy.  This does not
-   * cause the strx functions to overflow buffer.  The variable
-   * dest_end is the guard that prevents overflow.
-   */
-  const char *dest_end = buf + buf_size;
-  char *dest = buf;
+  logging_format_state_t st;
+  st.out = out;
+  st.iovcnt = 0;
+  st.scratch_p = st.scratch;
 
-  while (dest < dest_end - 1) {
+  while (!strx_buf_truncated(out)) {
     /* Copy the format string verbatim until the next occurrence of '%'. */
     const char *ahead = strchrnul(log_fmt, '%');
-    dest = strxcpy(dest, dest_end, log_fmt, ahead - log_fmt);
+    logging_add_piece(&st, log_fmt, ahead - log_fmt);
     if (*ahead == '\0')
       break;
 
@@ -129,31 +199,60 @@ size_t logging_formatter(logging_record_t *rec_p, const char *log_fmt,
       break;
     else if (*log_fmt == '(') {
       ahead = strchrnul(log_fmt, ')');
-      if (ahead == '\0')
-	break;
+      if (*ahead == '\0')
+        break;
 
       const char *subject = log_fmt + 1;
       int len = ahead - subject;
 
       char type = *(ahead + 1);
       if (type == 's' || type == 'd' || type == 'f') {
-        dest = logging_append_info(dest, dest_end, rec_p, subject, len);
+        logging_append_info(&st, rec_p, subject, len);
         ahead += 2;
       } else {
         /* Not a format specification.  Ignore. */
-        dest = strxcpy(dest, dest_end, log_fmt - 1, ahead - log_fmt + 2);
+        logging_add_piece(&st, log_fmt - 1, ahead - log_fmt + 2);
         ahead += 1;
       }
 
       log_fmt = ahead;
     }
     else {
-      dest = strxcpy(dest, dest_end, log_fmt, 1);
+      logging_add_piece(&st, log_fmt, 1);
       log_fmt++;
     }
   }
 
-  dest = strxcpy(dest, dest_end, "\n", 1);
+  logging_add_piece(&st, "\n", 1);
+  logging_flush_pieces(&st);
+}
 
-  return dest - buf;
+size_t logging_formatter(logging_record_t *rec_p, const char *log_fmt,
+                         char *buf, size_t buf_size)
+{
+  strx_buf_t out;
+  strx_buf_init(&out, buf, buf_size);
+  logging_format_record(rec_p, log_fmt, &out);
+  return strx_buf_len(&out);
+}
+
+void logging_end_truncated(strx_buf_t *out)
+{
+  if (strx_buf_truncated(out) && strx_buf_len(out) > 0)
+    out->cur[-1] = '\n';
+}
+
+void logging_write_fully(int fd, const void *buf, size_t len)
+{
+  const char *p = (const char *) buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      return;  /* nowhere to report */
+    }
+    p += n;
+    len -= n;
+  }
 }
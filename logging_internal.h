@@ -0,0 +1,39 @@
+/* Logging facility, helpers shared by its translation units.
+ * Copyright (C) 2009, 2010  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Not installed along with logging.h; only the logging sources include
+ * this.
+ */
+
+#ifndef __LOGGING_INTERNAL_H__
+#define __LOGGING_INTERNAL_H__
+
+#include <stddef.h>     /* size_t */
+
+#include "stringx.h"    /* strx_buf_t */
+
+/* Replaces the last character of a truncated record with a newline, so
+ * the next record still starts a line of its own.
+ */
+void logging_end_truncated(strx_buf_t *out);
+
+/* Writes all of buf, retrying after EINTR.  Only uses
+ * async-signal-safe calls.
+ */
+void logging_write_fully(int fd, const void *buf, size_t len);
+
+#endif  /* __LOGGING_INTERNAL_H__ */
@@ -0,0 +1,439 @@
+/* Block compressed log output.
+ * Copyright (C) 2009--2013  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Callers format records straight into the block being filled, under a
+ * lock.  Full blocks are sealed and queued to a writer thread, which
+ * compresses each block on its own and writes it out as one frame:
+ *
+ *   "LZBK", raw length, compressed length, checksum of the raw data
+ *   (32-bit little endian each, the checksum being FNV-1a), followed
+ *   by the compressed data.
+ *
+ * The checksum lets logging_unlz tell a damaged or torn frame from a
+ * good one, and resynchronize on the next frame that checks out.
+ *
+ * A compressed length of 0 means the data is stored as is, which is
+ * what happens to blocks that do not compress, and to the blocks that
+ * the fatal signal handler writes out.
+ *
+ * The compressed data is in the LZ4 block format: a sequence of
+ * literal runs, each followed by a match of at least 4 bytes copied
+ * from up to 64 KiB back, except the last run.
+ */
+
+#define _XOPEN_SOURCE 700  /* pthread_cond_timedwait(), clock_gettime() */
+
+#include "logging.h"
+#include "logging_internal.h"
+
+#include <pthread.h>    /* pthread_create(), pthread_mutex_lock() */
+#include <stdint.h>     /* uint32_t */
+#include <stdlib.h>     /* atexit(), free(), malloc() */
+#include <string.h>     /* memcpy(), memset() */
+#include <time.h>       /* clock_gettime() */
+
+#define LZ_MIN_MATCH            4
+#define LZ_MAX_OFFSET           65535
+#define LZ_HASH_BITS            12
+#define LZ_LAST_LITERALS        5
+#define LZ_MF_LIMIT             12      /* no match starts closer to the end */
+
+#define LZ_QUEUE_BLOCKS         4
+#define LZ_FLUSH_AGE            1.0     /* seconds */
+
+static uint32_t read32(const unsigned char *p)
+{
+  uint32_t x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static void write32(unsigned char *p, uint32_t x)
+{
+  p[0] = x;
+  p[1] = x >> 8;
+  p[2] = x >> 16;
+  p[3] = x >> 24;
+}
+
+static uint32_t lz_hash(uint32_t x)
+{
+  return (x * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static unsigned char *lz_put_length(unsigned char *op, size_t len)
+{
+  for ( ; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = (unsigned char) len;
+  return op;
+}
+
+static unsigned char *lz_put_sequence(unsigned char *op,
+                                      const unsigned char *literals,
+                                      size_t lit_len, size_t offset,
+                                      size_t match_len)
+{
+  unsigned char *token = op++;
+  *token = (lit_len >= 15)? 0xf0 : lit_len << 4;
+  if (lit_len >= 15)
+    op = lz_put_length(op, lit_len - 15);
+  memcpy(op, literals, lit_len);
+  op += lit_len;
+
+  if (offset == 0)  /* last run */
+    return op;
+
+  *op++ = offset & 0xff;
+  *op++ = offset >> 8;
+  match_len -= LZ_MIN_MATCH;
+  *token |= (match_len >= 15)? 0x0f : match_len;
+  if (match_len >= 15)
+    op = lz_put_length(op, match_len - 15);
+  return op;
+}
+
+size_t logging_lz_bound(size_t n)
+{
+  return n + n / 255 + 16;
+}
+
+size_t logging_lz_compress(void *dest, const void *src, size_t n)
+{
+  const unsigned char *base = (const unsigned char *) src;
+  const unsigned char *ip = base, *anchor = base;
+  const unsigned char *iend = base + n;
+  unsigned char *op = (unsigned char *) dest;
+
+  if (n > LZ_MF_LIMIT) {
+    const unsigned char *mflimit = iend - LZ_MF_LIMIT;
+    const unsigned char *matchlimit = iend - LZ_LAST_LITERALS;
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    while (ip < mflimit) {
+      uint32_t h = lz_hash(read32(ip));
+      const unsigned char *ref = base + table[h];
+      table[h] = ip - base;
+
+      if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(ref) != read32(ip)) {
+        ip += 1 + ((ip - anchor) >> 6);  /* skip faster through literals */
+        continue;
+      }
+
+      while (ip > anchor && ref > base && ip[-1] == ref[-1])
+        ip--, ref--;
+
+      const unsigned char *mp = ip + LZ_MIN_MATCH;
+      const unsigned char *rp = ref + LZ_MIN_MATCH;
+      while (mp < matchlimit && *mp == *rp)
+        mp++, rp++;
+
+      op = lz_put_sequence(op, anchor, ip - anchor, ip - ref, mp - ip);
+      ip = anchor = mp;
+
+      if (ip < mflimit)
+        table[lz_hash(read32(ip - 2))] = ip - 2 - base;
+    }
+  }
+
+  op = lz_put_sequence(op, anchor, iend - anchor, 0, 0);
+  return op - (unsigned char *) dest;
+}
+
+ssize_t logging_lz_decompress(void *dest, size_t dest_size,
+                              const void *src, size_t n)
+{
+  const unsigned char *ip = (const unsigned char *) src;
+  const unsigned char *iend = ip + n;
+  unsigned char *op = (unsigned char *) dest;
+  unsigned char *oend = op + dest_size;
+
+  while (ip < iend) {
+    unsigned int token = *ip++;
+    size_t len = token >> 4;
+    unsigned int b;
+
+    if (len == 15)
+      do {
+        if (ip == iend)
+          return -1;
+        len += b = *ip++;
+      } while (b == 255);
+
+    if (len > (size_t) (iend - ip) || len > (size_t) (oend - op))
+      return -1;
+    memcpy(op, ip, len);
+    op += len;
+    ip += len;
+
+    if (ip == iend)  /* last run */
+      break;
+
+    if (iend - ip < 2)
+      return -1;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (size_t) (op - (unsigned char *) dest))
+      return -1;
+
+    len = token & 0x0f;
+    if (len == 15)
+      do {
+        if (ip == iend)
+          return -1;
+        len += b = *ip++;
+      } while (b == 255);
+    len += LZ_MIN_MATCH;
+
+    if (len > (size_t) (oend - op))
+      return -1;
+    const unsigned char *ref = op - offset;
+    while (len-- > 0)  /* may overlap */
+      *op++ = *ref++;
+  }
+
+  return op - (unsigned char *) dest;
+}
+
+/* The output side.  Blocks in [g_write, g_fill) are sealed and queued,
+ * and block g_fill is being filled; indices are taken modulo
+ * LZ_QUEUE_BLOCKS.  A caller that seals a block waits while the queue
+ * is full, so a slow disk slows down callers rather than losing records.
+ */
+
+typedef struct {
+  char *data;           /* g_block_size + 1 bytes, for the terminator */
+  size_t len;
+  double since;         /* created of the first record */
+} lz_block_t;
+
+static lz_block_t g_blocks[LZ_QUEUE_BLOCKS];
+static size_t g_block_size = 0;
+static unsigned long g_fill = 0, g_write = 0;
+static int g_lz_fd = -1;
+static unsigned char *g_lz_out = NULL;  /* writer thread only */
+
+static pthread_mutex_t g_lz_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_lz_sealed = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_lz_written = PTHREAD_COND_INITIALIZER;
+
+#define BLOCK(i) (&g_blocks[(i) % LZ_QUEUE_BLOCKS])
+
+static double realtime_double()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint32_t logging_lz_checksum(uint32_t sum, const void *data, size_t n)
+{
+  const unsigned char *p = (const unsigned char *) data;
+  size_t i;
+  for (i = 0; i < n; i++) {
+    sum ^= p[i];
+    sum *= 16777619u;
+  }
+  return sum;
+}
+
+static void lz_frame_header(unsigned char *header, size_t raw_len,
+                            size_t comp_len, uint32_t sum)
+{
+  memcpy(header, LOGGING_LZ_MAGIC, 4);
+  write32(header + 4, raw_len);
+  write32(header + 8, comp_len);
+  write32(header + 12, sum);
+}
+
+/* Must be called with g_lz_lock held. */
+static void logging_lz_seal_locked()
+{
+  /* Other callers may fill or seal the block while this one waits. */
+  while (g_fill + 1 - g_write >= LZ_QUEUE_BLOCKS)
+    pthread_cond_wait(&g_lz_written, &g_lz_lock);
+
+  if (BLOCK(g_fill)->len == 0)
+    return;
+
+  __atomic_store_n(&BLOCK(g_fill + 1)->len, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&g_fill, g_fill + 1, __ATOMIC_RELEASE);
+  pthread_cond_signal(&g_lz_sealed);
+}
+
+static void *logging_lz_writer(void *arg)
+{
+  (void) arg;
+
+  pthread_mutex_lock(&g_lz_lock);
+  for (;;) {
+    while (g_write == g_fill) {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += 1;
+      pthread_cond_timedwait(&g_lz_sealed, &g_lz_lock, &ts);
+
+      /* Nothing is queued, so sealing does not wait for this thread. */
+      lz_block_t *b = BLOCK(g_fill);
+      if (b->len > 0 && realtime_double() - b->since >= LZ_FLUSH_AGE)
+        logging_lz_seal_locked();
+    }
+
+    lz_block_t *b = BLOCK(g_write);
+    pthread_mutex_unlock(&g_lz_lock);
+
+    unsigned char *data = g_lz_out + LOGGING_LZ_HEADER_SIZE;
+    size_t comp_len = logging_lz_compress(data, b->data, b->len);
+    if (comp_len >= b->len) {
+      memcpy(data, b->data, b->len);
+      comp_len = 0;
+    }
+    lz_frame_header(g_lz_out, b->len, comp_len,
+                    logging_lz_checksum(LOGGING_LZ_CHECKSUM_INIT,
+                                        b->data, b->len));
+    logging_write_fully(g_lz_fd, g_lz_out, LOGGING_LZ_HEADER_SIZE +
+                                           (comp_len? comp_len : b->len));
+
+    pthread_mutex_lock(&g_lz_lock);
+    __atomic_store_n(&g_write, g_write + 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&g_lz_written);
+  }
+
+  return NULL;
+}
+
+void logging_emit_lz(logging_record_t *rec_p)
+{
+  char buf[1024];
+  char *big_buf = NULL;
+  strx_buf_t out;
+
+  /* Formatted before taking the lock, so that callers only contend for
+   * the copy.  A record is at most a block.
+   */
+  strx_buf_init(&out, buf, sizeof(buf));
+  logging_format_record(rec_p, logging_log_format, &out);
+
+  if (strx_buf_truncated(&out) &&
+      (big_buf = (char *) malloc(g_block_size + 1)) != NULL) {
+    strx_buf_init(&out, big_buf, g_block_size + 1);
+    logging_format_record(rec_p, logging_log_format, &out);
+  }
+
+  /* Even a truncated record should end the line. */
+  logging_end_truncated(&out);
+  size_t len = strx_buf_len(&out);
+
+  pthread_mutex_lock(&g_lz_lock);
+
+  /* Other callers may fill the next block while this one waits. */
+  lz_block_t *b = BLOCK(g_fill);
+  while (b->len > 0 && len > g_block_size - b->len) {
+    logging_lz_seal_locked();
+    b = BLOCK(g_fill);
+  }
+
+  if (b->len == 0)
+    b->since = rec_p->created;
+  memcpy(b->data + b->len, out.base, len + 1);
+  __atomic_store_n(&b->len, b->len + len, __ATOMIC_RELEASE);
+
+  if (b->len == g_block_size || rec_p->created - b->since >= LZ_FLUSH_AGE)
+    logging_lz_seal_locked();
+
+  pthread_mutex_unlock(&g_lz_lock);
+  free(big_buf);
+}
+
+void logging_lz_flush()
+{
+  if (g_lz_fd == -1)
+    return;
+
+  pthread_mutex_lock(&g_lz_lock);
+  logging_lz_seal_locked();
+  while (g_write != g_fill)
+    pthread_cond_wait(&g_lz_written, &g_lz_lock);
+  pthread_mutex_unlock(&g_lz_lock);
+}
+
+int logging_lz_start(int fd, size_t block_size)
+{
+  if (g_lz_fd != -1)
+    return -1;
+
+  if (block_size < 1024)
+    block_size = 1024;
+  if (block_size > LOGGING_LZ_MAX_BLOCK_SIZE)
+    block_size = LOGGING_LZ_MAX_BLOCK_SIZE;
+
+  int i;
+  for (i = 0; i < LZ_QUEUE_BLOCKS; i++)
+    if ((g_blocks[i].data = (char *) malloc(block_size + 1)) == NULL)
+      return -1;
+  if ((g_lz_out = (unsigned char *) malloc(LOGGING_LZ_HEADER_SIZE +
+                                           logging_lz_bound(block_size)))
+      == NULL)
+    return -1;
+
+  g_block_size = block_size;
+  g_lz_fd = fd;
+
+  pthread_t writer;
+  if (pthread_create(&writer, NULL, logging_lz_writer, NULL) != 0) {
+    g_lz_fd = -1;
+    return -1;
+  }
+  pthread_detach(writer);
+
+  atexit(logging_lz_flush);
+  logging_emitter = logging_emit_lz;
+  return 0;
+}
+
+int logging_lz_crash_drain(const char *final, size_t len)
+{
+  if (g_lz_fd == -1)
+    return -1;
+
+  /* The block at g_write may be half written already; writing it again
+   * duplicates records rather than losing them.
+   */
+  unsigned char header[LOGGING_LZ_HEADER_SIZE];
+  unsigned long i = __atomic_load_n(&g_write, __ATOMIC_ACQUIRE);
+  unsigned long fill = __atomic_load_n(&g_fill, __ATOMIC_ACQUIRE);
+  for ( ; i < fill; i++) {
+    lz_block_t *b = BLOCK(i);
+    lz_frame_header(header, b->len, 0,
+                    logging_lz_checksum(LOGGING_LZ_CHECKSUM_INIT,
+                                        b->data, b->len));
+    logging_write_fully(g_lz_fd, header, sizeof(header));
+    logging_write_fully(g_lz_fd, b->data, b->len);
+  }
+
+  lz_block_t *b = BLOCK(fill);
+  size_t block_len = __atomic_load_n(&b->len, __ATOMIC_ACQUIRE);
+  uint32_t sum = logging_lz_checksum(LOGGING_LZ_CHECKSUM_INIT,
+                                     b->data, block_len);
+  lz_frame_header(header, block_len + len, 0,
+                  logging_lz_checksum(sum, final, len));
+  logging_write_fully(g_lz_fd, header, sizeof(header));
+  logging_write_fully(g_lz_fd, b->data, block_len);
+  logging_write_fully(g_lz_fd, final, len);
+  return 0;
+}
@@ -0,0 +1,205 @@
+#include "logging.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_RECORDS     2000
+
+static char g_log_file[64], g_damaged_file[64];
+
+static int round_trip(const char *label, const char *src, size_t n)
+{
+  char *comp = (char *) malloc(logging_lz_bound(n));
+  char *out = (char *) malloc(n + 1);
+  size_t comp_len = logging_lz_compress(comp, src, n);
+
+  int ok = logging_lz_decompress(out, n, comp, comp_len) == (ssize_t) n &&
+    memcmp(out, src, n) == 0;
+
+  /* Output that does not fit, and damaged input, are refused. */
+  if (n > 0)
+    ok &= logging_lz_decompress(out, n - 1, comp, comp_len) == -1;
+  if (comp_len > 1)
+    ok &= logging_lz_decompress(out, n + 1, comp, comp_len - 1)
+          != (ssize_t) n;
+
+  printf("%-10s %8zu -> %8zu %s\n", label, n, comp_len, ok? "ok" : "FAILED");
+  free(comp);
+  free(out);
+  return !ok;
+}
+
+/* Returns the number of records logging_unlz gets out of the file. */
+static int unlz_records(const char *file)
+{
+  char command[128], line[256];
+  snprintf(command, sizeof(command), "./logging_unlz %s 2>/dev/null", file);
+  FILE *p = popen(command, "r");
+  int records = 0, next = 0, i;
+  while (fgets(line, sizeof(line), p) != NULL) {
+    const char *s = strstr(line, "record ");
+    if (s && sscanf(s, "record %d", &i) == 1 && i >= next) {
+      next = i + 1;
+      records++;
+    }
+  }
+  pclose(p);
+  return records;
+}
+
+/* Returns the longest run of c on a line that logging_unlz gets out of
+ * the file.
+ */
+static int unlz_longest_run(const char *file, int c)
+{
+  char command[128];
+  snprintf(command, sizeof(command), "./logging_unlz %s 2>/dev/null", file);
+  FILE *p = popen(command, "r");
+  int run = 0, longest = 0, ch;
+  while ((ch = fgetc(p)) != EOF) {
+    run = (ch == c)? run + 1 : 0;
+    if (run > longest)
+      longest = run;
+  }
+  pclose(p);
+  return longest;
+}
+
+/* Returns the number of records in the frame at offset. */
+static int frame_records(const char *data, size_t offset)
+{
+  uint32_t raw_len, comp_len;
+  memcpy(&raw_len, data + offset + 4, 4);
+  memcpy(&comp_len, data + offset + 8, 4);
+
+  char *raw = (char *) malloc(raw_len);
+  const char *frame = data + offset + LOGGING_LZ_HEADER_SIZE;
+  if (comp_len)
+    logging_lz_decompress(raw, raw_len, frame, comp_len);
+  else
+    memcpy(raw, frame, raw_len);
+
+  int records = 0;
+  const char *p;
+  for (p = raw; (p = (const char *) memchr(p, '\n', raw + raw_len - p));
+       p++)
+    records++;
+  free(raw);
+  return records;
+}
+
+static void write_file(const char *file, const char *data, size_t n)
+{
+  FILE *f = fopen(file, "wb");
+  fwrite(data, n, 1, f);
+  fclose(f);
+}
+
+int main()
+{
+  int failures = 0, i;
+
+  /* Round trips. */
+  size_t n = 1 << 20;
+  char *src = (char *) malloc(n);
+  failures += round_trip("empty", "", 0);
+  failures += round_trip("one", "x", 1);
+  memset(src, 'a', n);
+  failures += round_trip("repeated", src, n);
+  srand(1);
+  for (i = 0; (size_t) i < n; i++)
+    src[i] = rand();
+  failures += round_trip("random", src, n);
+  char *p = src;
+  for (i = 0; p < src + n - 100; i++)
+    p += snprintf(p, 100, "2013-01-01 00:00:%02d - INFO - request %d\n",
+                  i % 60, i * 7);
+  failures += round_trip("records", src, p - src);
+  for (i = 0; i < 64; i++)
+    failures += round_trip("short", src + i, i);
+
+  /* A log of many small frames. */
+  snprintf(g_log_file, sizeof(g_log_file),
+           "/tmp/logging_lz_test.%d", (int) getpid());
+  snprintf(g_damaged_file, sizeof(g_damaged_file),
+           "/tmp/logging_lz_test.%d.damaged", (int) getpid());
+  logging_ensure_initialized();
+  int fd = open(g_log_file, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+  if (fd == -1 || logging_lz_start(fd, 4096) == -1) {
+    perror(g_log_file);
+    return 1;
+  }
+  /* Records longer than the stack buffer, and than a block. */
+  memset(src, 'y', 3000);
+  src[3000] = '\0';
+  INFO("long %s", src);
+  memset(src, 'z', 10000);
+  src[10000] = '\0';
+  INFO("huge %s", src);
+  for (i = 0; i < NUM_RECORDS; i++)
+    INFO("record %d", i);
+  logging_lz_flush();
+  close(fd);
+
+  FILE *f = fopen(g_log_file, "rb");
+  size_t log_size = fread(src, 1, n, f);
+  fclose(f);
+
+  size_t frames[NUM_RECORDS], num_frames = 0, offset;
+  for (offset = 0; offset < log_size; num_frames++) {
+    uint32_t raw_len, comp_len;
+    memcpy(&raw_len, src + offset + 4, 4);
+    memcpy(&comp_len, src + offset + 8, 4);
+    frames[num_frames] = offset;
+    offset += LOGGING_LZ_HEADER_SIZE + (comp_len? comp_len : raw_len);
+  }
+  size_t k = num_frames / 2;
+  int in_k = frame_records(src, frames[k]);
+  int in_last = frame_records(src, frames[num_frames - 1]);
+
+  int got = unlz_records(g_log_file);
+  printf("intact: %d of %d records\n", got, NUM_RECORDS);
+  failures += got != NUM_RECORDS;
+
+  int long_run = unlz_longest_run(g_log_file, 'y');
+  int huge_run = unlz_longest_run(g_log_file, 'z');
+  printf("long: %d of 3000, huge: %d of 10000\n", long_run, huge_run);
+  failures += long_run != 3000;
+  failures += huge_run == 0 || huge_run >= 4096;
+
+  /* Truncated in the last frame. */
+  write_file(g_damaged_file, src, frames[num_frames - 1] + 20);
+  got = unlz_records(g_damaged_file);
+  printf("truncated: %d of %d records\n", got, NUM_RECORDS - in_last);
+  failures += got != NUM_RECORDS - in_last;
+
+  /* A damaged byte in the middle frame. */
+  src[frames[k] + LOGGING_LZ_HEADER_SIZE + 10] ^= 0x55;
+  write_file(g_damaged_file, src, log_size);
+  src[frames[k] + LOGGING_LZ_HEADER_SIZE + 10] ^= 0x55;
+  got = unlz_records(g_damaged_file);
+  printf("corrupt: %d of %d records\n", got, NUM_RECORDS - in_k);
+  failures += got != NUM_RECORDS - in_k;
+
+  /* The middle frame torn, with the rest written over it, as the fatal
+   * signal handler would.
+   */
+  size_t tear = (frames[k + 1] - frames[k]) / 2;
+  memmove(src + frames[k] + tear, src + frames[k + 1],
+          log_size - frames[k + 1]);
+  write_file(g_damaged_file, src, log_size - (frames[k + 1] - frames[k]) +
+                                  tear);
+  got = unlz_records(g_damaged_file);
+  printf("torn: %d of %d records\n", got, NUM_RECORDS - in_k);
+  failures += got != NUM_RECORDS - in_k;
+
+  unlink(g_log_file);
+  unlink(g_damaged_file);
+  free(src);
+
+  printf("%s\n", failures? "FAIL" : "PASS");
+  return failures != 0;
+}
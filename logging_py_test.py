@@ -1,18 +1,101 @@
 #!/usr/bin/env python
 
 import logging
+import optparse
+import re
+import threading
+import time
 
-def main():
+# Monotonic and high resolution where available, like CLOCK_MONOTONIC
+# in logging_bench.c.
+clock = getattr(time, 'perf_counter', time.time)
+
+# Variables of logging_variables.txt that the Python records here do
+# not have, or do not have in the same form.
+C_ONLY_VARIABLES = ('funcName', 'context', 'context_json')
+
+def make_format():
   format = ''
   for v in open('logging_variables.txt'):
-    if v.strip() == 'funcName': continue
+    if v.strip() in C_ONLY_VARIABLES: continue
     format += '%(' + v.strip() + ')s '
+  return format
+
+def python_format(format):
+  """Drops the C only variables from a format shared with logging_bench."""
+  return re.sub(r'%%\((%s)\)s ?' % '|'.join(C_ONLY_VARIABLES), '', format)
+
+def producer(calls, pass_ratio, payload, latencies, emitted):
+  acc = 0.0
+  for i in range(0, calls):
+    t0 = clock()
+    acc += pass_ratio
+    if acc >= 1.0:
+      acc -= 1.0
+      logging.info('i = %d %s', i, payload)
+      emitted.append(i)
+    else:
+      logging.debug('i = %d %s', i, payload)
+    latencies.append(clock() - t0)
+
+def percentile(sorted_latencies, q):
+  k = min(int(q * len(sorted_latencies)), len(sorted_latencies) - 1)
+  return int(sorted_latencies[k] * 1e9)
+
+def bench(options):
+  """Mirrors logging_bench.c and prints the same report line."""
+
+  handler = logging.FileHandler(options.output) if options.output \
+      else logging.StreamHandler()
+  format = python_format(options.format) if options.format else make_format()
+  handler.setFormatter(logging.Formatter(format))
+  logging.getLogger().addHandler(handler)
+  logging.getLogger().setLevel(logging.INFO)
 
-  logging.basicConfig(level=logging.INFO, format=format)
+  payload = 'x' * options.size
+  latencies = [[] for _ in range(options.threads)]
+  emitted = []
+  threads = [threading.Thread(target=producer,
+                              args=(options.calls, options.ratio, payload,
+                                    l, emitted))
+             for l in latencies]
 
-  for i in xrange(0, 5):
+  t0 = clock()
+  for t in threads: t.start()
+  for t in threads: t.join()
+  elapsed = clock() - t0
+
+  total = options.calls * options.threads
+  samples = sorted(sum(latencies, []))
+  print('%-8s threads=%-3d size=%-5d pass=%.2f '
+        'calls/s=%-10.0f records/s=%-10.0f '
+        'p50=%dns p99=%dns p999=%dns' % (
+      options.label, options.threads, options.size, options.ratio,
+      total / elapsed, len(emitted) / elapsed,
+      percentile(samples, 0.50),
+      percentile(samples, 0.99),
+      percentile(samples, 0.999)))
+
+def main():
+  parser = optparse.OptionParser()
+  parser.add_option('-b', dest='bench', action='store_true', default=False)
+  parser.add_option('-t', dest='threads', type='int', default=1)
+  parser.add_option('-n', dest='calls', type='int', default=100000)
+  parser.add_option('-s', dest='size', type='int', default=64)
+  parser.add_option('-r', dest='ratio', type='float', default=1.0)
+  parser.add_option('-o', dest='output', default=None)
+  parser.add_option('-f', dest='format', default=None)
+  parser.add_option('-l', dest='label', default='Python')
+  (options, args) = parser.parse_args()
+
+  if options.bench:
+    bench(options)
+    return
+
+  logging.basicConfig(level=logging.INFO, format=make_format())
+
+  for i in range(0, 5):
     logging.info('i = %d' % i)
 
 if __name__ == '__main__':
   main()
-
@@ -0,0 +1,356 @@
+/* Prints a time range of a log file using its time index.
+ * Copyright (C) 2009--2013  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Usage: logging_query [-f from] [-t to] [-l level] [-i index] file
+ *
+ * Prints the records of file logged from time from up to time to, both
+ * either seconds since the epoch or local time in LOGGING_TIME_FORMAT
+ * (by default "%Y-%m-%d %H:%M:%S"), and of at least the given level,
+ * either a name like WARN or a number.  The index defaults to file plus
+ * ".idx", see logging_index_start().
+ *
+ * The log file and index are mapped, and the index is binary searched
+ * for the checkpoints around the range, so only that part of the log
+ * is read.  Records between checkpoints inside the range are copied as
+ * they are; only in the two intervals at the edges of the range is the
+ * time of each record parsed, from the start of its first line, to
+ * trim them to the range.  Since the time has a resolution of seconds,
+ * a record counts as in the range if any part of its second is.
+ *
+ * This needs a log format that starts with %(asctime)s; if no line at
+ * the edges starts with a time, the edges are printed untrimmed, with
+ * a warning.
+ *
+ * The level of a record is the first level name that appears in it as
+ * a word, which works with the usual formats; lines without one, or
+ * without a time at the start, such as the continuation of a
+ * multi-line message, go with the record before them.
+ */
+
+#define _GNU_SOURCE     /* memmem(), strptime() */
+
+#include "logging.h"
+
+#include <ctype.h>      /* isalnum() */
+#include <fcntl.h>      /* open(), O_RDONLY */
+#include <stdint.h>     /* int64_t, uint64_t */
+#include <stdio.h>      /* fprintf(), fwrite(), perror() */
+#include <stdlib.h>     /* getenv(), strtod(), strtol() */
+#include <string.h>     /* memchr(), memcmp(), memmem(), memset() */
+#include <sys/mman.h>   /* mmap() */
+#include <sys/stat.h>   /* fstat() */
+#include <time.h>       /* mktime(), strptime() */
+#include <unistd.h>     /* getopt(), close() */
+
+typedef struct {
+  int key;
+  const char *data;
+} int_sz_pair_t;
+
+#define LOG_LEVEL_ENTRY(name) { LOG_ ## name, #name }
+
+static const int_sz_pair_t k_log_level_names[] = {
+  LOG_LEVEL_ENTRY(DEBUG),
+  LOG_LEVEL_ENTRY(INFO),
+  LOG_LEVEL_ENTRY(WARN),
+  LOG_LEVEL_ENTRY(ERROR),
+  LOG_LEVEL_ENTRY(CRIT),
+};
+
+#define countof(var) (sizeof(var) / sizeof(var[0]))
+
+static int is_word_char(char c)
+{
+  return isalnum((unsigned char) c) || c == '_';
+}
+
+/* Returns the level of the first level name in the line, or -1. */
+static int level_of_line(const char *line, size_t len)
+{
+  const char *first = line + len, *end = line + len;
+  int level = -1;
+  size_t i;
+
+  for (i = 0; i < countof(k_log_level_names); i++) {
+    const char *name = k_log_level_names[i].data;
+    size_t name_len = strlen(name);
+    const char *p = line;
+
+    while (p < first &&
+           (p = (const char *) memmem(p, end - p, name, name_len)) != NULL &&
+           p < first) {
+      if ((p == line || !is_word_char(p[-1])) &&
+          (p + name_len == end || !is_word_char(p[name_len]))) {
+        first = p;
+        level = k_log_level_names[i].key;
+        break;
+      }
+      p++;
+    }
+  }
+
+  return level;
+}
+
+static int parse_level(const char *s)
+{
+  size_t i;
+  for (i = 0; i < countof(k_log_level_names); i++)
+    if (strcmp(s, k_log_level_names[i].data) == 0)
+      return k_log_level_names[i].key;
+  if (strcmp(s, "WARNING") == 0)
+    return LOG_WARN;
+  if (strcmp(s, "CRITICAL") == 0)
+    return LOG_CRIT;
+  return strtol(s, (char **) NULL, 10);
+}
+
+/* Returns microseconds since the epoch, or -1 if s cannot be parsed. */
+static int64_t parse_time(const char *s, const char *time_format)
+{
+  struct tm tms;
+  memset(&tms, 0, sizeof(tms));
+  tms.tm_isdst = -1;
+
+  const char *end = strptime(s, time_format, &tms);
+  if (end != NULL && *end == '\0')
+    return (int64_t) mktime(&tms) * 1000000;
+
+  char *num_end;
+  double t = strtod(s, &num_end);
+  if (num_end != s && *num_end == '\0')
+    return (int64_t) (t * 1e6);
+
+  return -1;
+}
+
+/* Returns the time at the start of the line in microseconds since the
+ * epoch, or -1 if it does not start with a time.
+ */
+static int64_t time_of_line(const char *line, size_t len,
+                            const char *time_format)
+{
+  char buf[128];
+  if (len >= sizeof(buf))
+    len = sizeof(buf) - 1;
+  memcpy(buf, line, len);
+  buf[len] = '\0';
+
+  struct tm tms;
+  memset(&tms, 0, sizeof(tms));
+  tms.tm_isdst = -1;
+  if (strptime(buf, time_format, &tms) == NULL)
+    return -1;
+  return (int64_t) mktime(&tms) * 1000000;
+}
+
+typedef struct {
+  int min_level;
+  int64_t from, to;
+  const char *time_format;
+  int keep_level;       /* of the current record */
+  int keep_time;
+  size_t checked_lines, timed_lines;    /* at the edges */
+} filter_t;
+
+/* Prints the lines in [p, stop) of records of at least the minimum
+ * level, and if check_time, also in the time range.
+ */
+static void print_records(filter_t *f, const char *p, const char *stop,
+                          int check_time)
+{
+  if (f->min_level == LOG_NOTSET && !check_time) {
+    fwrite(p, stop - p, 1, stdout);
+    return;
+  }
+
+  while (p < stop) {
+    const char *eol = (const char *) memchr(p, '\n', stop - p);
+    const char *next = eol? eol + 1 : stop;
+
+    int level = level_of_line(p, next - p);
+    if (level != -1)
+      f->keep_level = level >= f->min_level;
+
+    int64_t t;
+    if (check_time) {
+      f->checked_lines++;
+      if ((t = time_of_line(p, next - p, f->time_format)) != -1) {
+        f->timed_lines++;
+        f->keep_time = t + 1000000 > f->from && t <= f->to;
+      }
+    }
+
+    if (f->keep_level && (f->keep_time || !check_time))
+      fwrite(p, next - p, 1, stdout);
+    p = next;
+  }
+}
+
+/* Returns the index of the first checkpoint at or after usec. */
+static size_t lower_bound(const logging_index_entry_t *entries, size_t n,
+                          int64_t usec)
+{
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (entries[mid].usec < usec)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static const void *map_file(const char *pathname, size_t *size_p)
+{
+  int fd = open(pathname, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+
+  struct stat st;
+  const void *p = NULL;
+  if (fstat(fd, &st) == 0) {
+    *size_p = st.st_size;
+    p = (st.st_size == 0)? "" :
+      mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+      p = NULL;
+  }
+  close(fd);
+  return p;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr, "usage: %s [-f from] [-t to] [-l level] [-i index] file\n",
+          argv0);
+}
+
+int main(int argc, char **argv)
+{
+  const char *time_format = getenv("LOGGING_TIME_FORMAT");
+  if (time_format == NULL)
+    time_format = logging_time_format;
+
+  int64_t from = INT64_MIN, to = INT64_MAX;
+  int min_level = LOG_NOTSET;
+  const char *index_file = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:t:l:i:")) != -1) {
+    switch (opt) {
+    case 'f':
+    case 't': {
+      int64_t t = parse_time(optarg, time_format);
+      if (t == -1) {
+        fprintf(stderr, "%s: cannot parse time %s\n", argv[0], optarg);
+        return 1;
+      }
+      *(opt == 'f'? &from : &to) = t;
+      break;
+    }
+    case 'l': min_level = parse_level(optarg); break;
+    case 'i': index_file = optarg; break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const char *log_file = argv[optind];
+  char default_index_file[4096];
+  if (index_file == NULL) {
+    char *p = strxcpy(default_index_file,
+                      default_index_file + sizeof(default_index_file),
+                      log_file, SIZE_MAX);
+    strxcpy(p, default_index_file + sizeof(default_index_file),
+            ".idx", SIZE_MAX);
+    index_file = default_index_file;
+  }
+
+  size_t log_size, index_size;
+  const char *log = (const char *) map_file(log_file, &log_size);
+  if (log == NULL) {
+    perror(log_file);
+    return 1;
+  }
+  const char *index = (const char *) map_file(index_file, &index_size);
+  if (index == NULL) {
+    perror(index_file);
+    return 1;
+  }
+  if (index_size < 8 || memcmp(index, LOGGING_INDEX_MAGIC, 8) != 0) {
+    fprintf(stderr, "%s: not a log index\n", index_file);
+    return 1;
+  }
+
+  const logging_index_entry_t *entries =
+    (const logging_index_entry_t *) (index + 8);
+  size_t n = (index_size - 8) / sizeof(logging_index_entry_t);
+
+  /* Start at the last checkpoint before the second of from, and end at
+   * the first checkpoint after the second of to.  A concurrent writer
+   * may have written records past the last checkpoint, so without one
+   * the end is the file end.
+   */
+  int64_t from_sec = (from == INT64_MIN)? from : from - from % 1000000;
+  size_t i = lower_bound(entries, n, from_sec);
+  uint64_t begin = (i > 0)? entries[i - 1].offset : 0;
+  size_t j = (to == INT64_MAX)? n :
+    lower_bound(entries, n, to - to % 1000000 + 1000000);
+  uint64_t end = (j < n)? entries[j].offset : log_size;
+  if (end > log_size)
+    end = log_size;
+
+  /* Records between checkpoint i, the first in the range, and
+   * checkpoint j - 1, the last, are all in the range.
+   */
+  uint64_t inner_begin = (i < n)? entries[i].offset : end;
+  uint64_t inner_end = (j > 0)? entries[j - 1].offset : begin;
+  if (inner_begin > end)
+    inner_begin = end;
+  if (inner_end < inner_begin)
+    inner_end = inner_begin;
+
+  filter_t f;
+  f.min_level = min_level;
+  f.from = from;
+  f.to = to;
+  f.time_format = time_format;
+  f.keep_level = f.keep_time = 1;
+  f.checked_lines = f.timed_lines = 0;
+
+  int ranged = from != INT64_MIN || to != INT64_MAX;
+  print_records(&f, log + begin, log + inner_begin, ranged);
+  print_records(&f, log + inner_begin, log + inner_end, 0);
+  print_records(&f, log + inner_end, log + end, ranged);
+
+  /* Nothing at the edges parsed as a time: the log format does not
+   * start with %(asctime)s, or the time format differs.
+   */
+  if (f.checked_lines > 0 && f.timed_lines == 0)
+    fprintf(stderr, "%s: warning: no line at the edges of the range starts "
+            "with a time in \"%s\", so they were not trimmed\n",
+            log_file, time_format);
+
+  return 0;
+}
@@ -0,0 +1,235 @@
+#include "logging.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NUM_SECONDS     10
+#define PER_SECOND      5
+
+static char g_log_file[64], g_index_file[64];
+
+static const char *k_levels[] = { "INFO", "WARN", "ERROR", "DEBUG" };
+static const int k_level_numbers[] = { LOG_INFO, LOG_WARN, LOG_ERROR,
+                                       LOG_DEBUG };
+
+/* A log of PER_SECOND records a second for NUM_SECONDS seconds from t0,
+ * some with a continuation line, and an index with a checkpoint at the
+ * first record of every other second.
+ */
+static char g_log[16384];
+
+static void write_log(time_t t0, int timed)
+{
+  FILE *log = fopen(g_log_file, "w"), *index = fopen(g_index_file, "w");
+  char *p = g_log;
+  int s, r;
+
+  fwrite(LOGGING_INDEX_MAGIC, 8, 1, index);
+  for (s = 0; s < NUM_SECONDS; s++)
+    for (r = 0; r < PER_SECOND; r++) {
+      if (r == 0 && s % 2 == 0) {
+        logging_index_entry_t entry;
+        entry.usec = ((int64_t) t0 + s) * 1000000 + 250000;
+        entry.offset = p - g_log;
+        fwrite(&entry, sizeof(entry), 1, index);
+      }
+      if (timed) {
+        time_t t = t0 + s;
+        struct tm tms;
+        p += strftime(p, 32, "%Y-%m-%d %H:%M:%S - ", localtime_r(&t, &tms));
+      }
+      p += sprintf(p, "%s - sec %d rec %d\n", k_levels[(s + r) % 4], s, r);
+      if (r == 2)
+        p += sprintf(p, "  continued %d %d\n", s, r);
+    }
+
+  fwrite(g_log, p - g_log, 1, log);
+  fclose(log);
+  fclose(index);
+}
+
+/* The records of g_log logged from second from to second to, of at
+ * least min_level.
+ */
+static void expected_output(char *out, int from, int to, int min_level)
+{
+  const char *p = g_log;
+  int keep = 0, s, r;
+  while (*p) {
+    const char *next = strchr(p, '\n') + 1;
+    const char *rec = strstr(p, "sec ");
+    if (rec && rec < next && sscanf(rec, "sec %d rec %d", &s, &r) == 2)
+      keep = s >= from && s <= to &&
+             k_level_numbers[(s + r) % 4] >= min_level;
+    if (keep) {
+      memcpy(out, p, next - p);
+      out += next - p;
+    }
+    p = next;
+  }
+  *out = '\0';
+}
+
+/* Runs logging_query with args, returning what it printed to stdout, or
+ * to stderr if errors.
+ */
+static const char *query(const char *args, int errors)
+{
+  static char out[16384];
+  char command[256];
+  snprintf(command, sizeof(command), "./logging_query %s %s %s", args,
+           g_log_file, errors? "2>&1 >/dev/null" : "2>/dev/null");
+  FILE *p = popen(command, "r");
+  size_t n = fread(out, 1, sizeof(out) - 1, p);
+  out[n] = '\0';
+  pclose(p);
+  return out;
+}
+
+static int check_query(const char *label, time_t t0, int from, int to,
+                       const char *level, int min_level)
+{
+  char args[128], *a = args;
+  static char expected[16384];
+
+  *a = '\0';
+  if (from >= 0)
+    a += sprintf(a, "-f %lld ", (long long) t0 + from);
+  if (to >= 0)
+    a += sprintf(a, "-t %lld ", (long long) t0 + to);
+  if (level)
+    a += sprintf(a, "-l %s ", level);
+
+  expected_output(expected, (from >= 0)? from : 0,
+                  (to >= 0)? to : NUM_SECONDS, min_level);
+  const char *got = query(args, 0);
+  int failed = strcmp(got, expected) != 0;
+  printf("%s: %s\n", label, failed? "FAILED" : "ok");
+  if (failed)
+    printf("got:\n%sexpected:\n%s", got, expected);
+  return failed;
+}
+
+/* Checks the index logging keeps itself: checkpoints in order, each at
+ * the start of a line logged in the same second.
+ */
+static int check_sidecar()
+{
+  setenv("LOGGING_LOG_FILE", g_log_file, 1);
+  setenv("LOGGING_INDEX_INTERVAL", "0.05", 1);
+  unsetenv("LOGGING_BUFFER_SIZE");
+  unsetenv("LOGGING_COMPRESS_BLOCK_SIZE");
+  unlink(g_log_file);
+  unlink(g_index_file);
+
+  int i;
+  for (i = 0; i < 20; i++) {
+    INFO("sidecar %d", i);
+    usleep(20000);
+  }
+
+  FILE *f = fopen(g_log_file, "r");
+  size_t log_size = fread(g_log, 1, sizeof(g_log) - 1, f);
+  g_log[log_size] = '\0';
+  fclose(f);
+
+  char index[4096];
+  f = fopen(g_index_file, "r");
+  size_t index_size = fread(index, 1, sizeof(index), f);
+  fclose(f);
+
+  int failures = index_size < 8 || memcmp(index, LOGGING_INDEX_MAGIC, 8);
+  size_t n = (index_size - 8) / sizeof(logging_index_entry_t), k;
+  logging_index_entry_t prev = { 0, 0 };
+  for (k = 0; k < n && !failures; k++) {
+    logging_index_entry_t entry;
+    memcpy(&entry, index + 8 + k * sizeof(entry), sizeof(entry));
+    failures += entry.usec < prev.usec || entry.offset >= log_size ||
+      (k > 0 && entry.offset <= prev.offset) ||
+      (entry.offset > 0 && g_log[entry.offset - 1] != '\n');
+
+    struct tm tms;
+    memset(&tms, 0, sizeof(tms));
+    tms.tm_isdst = -1;
+    sscanf(g_log + entry.offset, "%d-%d-%d %d:%d:%d", &tms.tm_year,
+           &tms.tm_mon, &tms.tm_mday, &tms.tm_hour, &tms.tm_min, &tms.tm_sec);
+    tms.tm_year -= 1900;
+    tms.tm_mon -= 1;
+    long long skew = (long long) mktime(&tms) - entry.usec / 1000000;
+    failures += skew < -1 || skew > 1;
+    prev = entry;
+  }
+  printf("sidecar: %zu checkpoints for 20 records %s\n", n,
+         failures? "FAILED" : "ok");
+  failures += n < 5;
+
+  /* Without a range or level, the whole log. */
+  int res = strcmp(query("", 0), g_log) != 0;
+  printf("sidecar query: %s\n", res? "FAILED" : "ok");
+  return failures + res;
+}
+
+/* An index needs the time at the start of each line. */
+static int check_untimed_format()
+{
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    logging_ensure_initialized();
+    stdlog = fopen(g_log_file, "w");
+    logging_log_format = "%(levelname)s - %(message)s";
+    _exit(!(logging_index_start(g_index_file, 1.0) == -1 &&
+            errno == EINVAL));
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  int res = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  printf("untimed index: %s\n", res? "FAILED" : "refused");
+  return res;
+}
+
+int main()
+{
+  int failures = 0;
+
+  snprintf(g_log_file, sizeof(g_log_file),
+           "/tmp/logging_query_test.%d", (int) getpid());
+  snprintf(g_index_file, sizeof(g_index_file),
+           "/tmp/logging_query_test.%d.idx", (int) getpid());
+  unsetenv("LOGGING_TIME_FORMAT");
+
+  time_t t0 = time(NULL) - 3600;
+  write_log(t0, 1);
+
+  failures += check_query("all", t0, -1, -1, NULL, LOG_NOTSET);
+  failures += check_query("range", t0, 3, 6, NULL, LOG_NOTSET);
+  failures += check_query("at checkpoints", t0, 2, 4, NULL, LOG_NOTSET);
+  failures += check_query("from", t0, 7, -1, NULL, LOG_NOTSET);
+  failures += check_query("to", t0, -1, 0, NULL, LOG_NOTSET);
+  failures += check_query("level", t0, -1, -1, "WARN", LOG_WARN);
+  failures += check_query("range and level", t0, 1, 8, "ERROR", LOG_ERROR);
+  failures += check_query("before", t0, -1, -5, NULL, LOG_NOTSET);
+
+  /* Lines without a time cannot be trimmed, and that is reported. */
+  write_log(t0, 0);
+  char args[64];
+  snprintf(args, sizeof(args), "-f %lld", (long long) t0 + 3);
+  int res = strstr(query(args, 1), "warning") == NULL;
+  printf("untimed query: %s\n", res? "FAILED" : "warned");
+  failures += res;
+
+  failures += check_untimed_format();
+  failures += check_sidecar();
+
+  unlink(g_log_file);
+  unlink(g_index_file);
+
+  printf("%s\n", failures? "FAIL" : "PASS");
+  return failures != 0;
+}
@@ -0,0 +1,441 @@
+/* Logging facility shared memory ring.
+ * Copyright (C) 2009, 2010  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The ring is an array of fixed size slots in shared memory, each with
+ * a sequence number, in the style of a bounded MPMC queue:
+ *
+ *   - A slot is free for the writer of position pos when its sequence
+ *     number equals pos.  The writer claims it by compare-and-swap of
+ *     the sequence number to a claim that carries its pid, and then
+ *     moves the shared head past pos.  Other writers that find a
+ *     claimed slot at the head move the head along for it, so there is
+ *     no lock that a crashed worker could leave behind.
+ *
+ *   - The writer then fills in the slot and commits it by setting the
+ *     sequence number to pos + 1.
+ *
+ *   - The collector drains committed slots in position order and
+ *     frees each one by setting its sequence number to pos + num_slots.
+ *
+ * If the ring is full, the record is dropped and counted against the
+ * writer process.  Since the claim names its writer from the start, a
+ * claimed slot is only ever skipped once its writer is gone, after a
+ * timeout; a writer that is merely slow, or stopped, holds up the
+ * collector but never loses its slot.
+ */
+
+#define _GNU_SOURCE     /* memfd_create(), kill() */
+
+#include "logging.h"
+#include "logging_internal.h"
+
+#include <errno.h>      /* errno, ESRCH */
+#include <fcntl.h>      /* O_CREAT, O_EXCL, O_RDWR */
+#include <signal.h>     /* kill(), sig_atomic_t */
+#include <stdint.h>     /* uint32_t, uint64_t */
+#include <stdlib.h>     /* _exit() */
+#include <string.h>     /* memcpy() */
+#include <sys/mman.h>   /* mmap(), memfd_create(), shm_open(), shm_unlink() */
+#include <sys/stat.h>   /* fstat() */
+#include <time.h>       /* clock_gettime(), nanosleep() */
+#include <unistd.h>     /* ftruncate(), getpid(), getppid() */
+
+#define SHM_RING_MAGIC          0x31474e4952474f4cull  /* "LOGRING1" */
+#define SHM_RING_MAX_PROCS      256
+#define SHM_SLOT_HEADER_SIZE    16
+
+/* An uncommitted slot is skipped once its writer is gone for this
+ * long.  Entries of processes that are gone are reclaimed at most this
+ * often.
+ */
+#define SHM_STALL_TIMEOUT_NS    1000000000ull
+#define SHM_RECLAIM_INTERVAL_NS 1000000000ull
+
+/* A claimed slot has the top bit of its sequence number set, the pid
+ * of its writer in the upper half and the low half of pos below.
+ */
+#define SHM_SEQ_CLAIMED         (1ull << 63)
+#define SHM_SEQ_CLAIM(pos, pid) \
+  (SHM_SEQ_CLAIMED | (uint64_t) (uint32_t) (pid) << 32 | (uint32_t) (pos))
+#define SHM_SEQ_IS_CLAIM(seq)   ((seq) & SHM_SEQ_CLAIMED)
+#define SHM_SEQ_CLAIM_PID(seq)  ((pid_t) (((seq) & ~SHM_SEQ_CLAIMED) >> 32))
+#define SHM_SEQ_CLAIM_POS(seq)  ((uint32_t) (seq))
+
+typedef struct {
+  int32_t pid;
+  uint32_t pad;
+  uint64_t drops;
+  uint64_t reported;    /* collector private */
+} shm_ring_proc_t;
+
+typedef struct {
+  uint64_t magic;
+  uint32_t num_slots;   /* a power of two */
+  uint32_t slot_size;
+  uint64_t head __attribute__(( aligned(64) ));
+  uint64_t tail __attribute__(( aligned(64) ));
+  shm_ring_proc_t procs[SHM_RING_MAX_PROCS] __attribute__(( aligned(64) ));
+} shm_ring_header_t;
+
+typedef struct {
+  uint64_t seq;
+  uint32_t len;
+  uint32_t pad;
+  char data[];
+} shm_ring_slot_t;
+
+static shm_ring_header_t *g_ring = NULL;
+static size_t g_ring_size = 0;
+
+/* Index of this process in g_ring->procs, valid while g_proc_pid matches. */
+static int g_proc_index = -1;
+static pid_t g_proc_pid = 0;
+
+#define SLOT(ring, pos) \
+  ((shm_ring_slot_t *) ((char *) ((ring) + 1) + \
+                        ((pos) & ((ring)->num_slots - 1)) * (ring)->slot_size))
+
+static uint64_t monotonic_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static shm_ring_header_t *logging_shm_map(int fd, size_t size)
+{
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return (p == MAP_FAILED)? NULL : (shm_ring_header_t *) p;
+}
+
+/* Checks that the header of a ring someone else created describes slots
+ * that fit in the segment and in the buffer of logging_emit_shm().
+ */
+static int logging_shm_is_valid(const shm_ring_header_t *ring, size_t size)
+{
+  if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC)
+    return 0;
+
+  size_t num_slots = ring->num_slots, slot_size = ring->slot_size;
+  if (slot_size < SHM_SLOT_HEADER_SIZE + 64 ||
+      slot_size > LOGGING_SHM_MAX_SLOT_SIZE || slot_size % 8 != 0)
+    return 0;
+  if (num_slots == 0 || (num_slots & (num_slots - 1)) != 0)
+    return 0;
+  return num_slots <= (size - sizeof(shm_ring_header_t)) / slot_size;
+}
+
+int logging_shm_create(const char *name, size_t num_slots, size_t slot_size)
+{
+  size_t n;
+  for (n = 1; n < num_slots; n <<= 1)
+    ;
+  num_slots = n;
+
+  if (slot_size < SHM_SLOT_HEADER_SIZE + 64)
+    slot_size = SHM_SLOT_HEADER_SIZE + 64;
+  if (slot_size > LOGGING_SHM_MAX_SLOT_SIZE)
+    slot_size = LOGGING_SHM_MAX_SLOT_SIZE;
+  slot_size = (slot_size + 7) & ~(size_t) 7;
+
+  /* Never reinitialize a ring that others may be using. */
+  int fd = name? shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600)
+               : memfd_create("logging_shm", 0);
+  if (fd == -1)
+    return -1;
+
+  size_t size = sizeof(shm_ring_header_t) + num_slots * slot_size;
+  shm_ring_header_t *ring;
+  if (ftruncate(fd, size) == -1 || (ring = logging_shm_map(fd, size)) == NULL) {
+    close(fd);
+    return -1;
+  }
+  close(fd);  /* the mapping stays */
+
+  g_ring = ring;
+  g_ring_size = size;
+  g_ring->num_slots = num_slots;
+  g_ring->slot_size = slot_size;
+  g_ring->head = g_ring->tail = 0;
+  for (n = 0; n < num_slots; n++)
+    SLOT(g_ring, n)->seq = n;
+  __atomic_store_n(&g_ring->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+  logging_emitter = logging_emit_shm;
+  return 0;
+}
+
+int logging_shm_unlink(const char *name)
+{
+  return shm_unlink(name);
+}
+
+int logging_shm_attach(const char *name)
+{
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd == -1)
+    return -1;
+
+  struct stat st;
+  shm_ring_header_t *ring = NULL;
+  if (fstat(fd, &st) == -1 ||
+      ((size_t) st.st_size >= sizeof(shm_ring_header_t) &&
+       (ring = logging_shm_map(fd, st.st_size)) == NULL)) {
+    close(fd);
+    return -1;
+  }
+  close(fd);
+
+  if (ring == NULL || !logging_shm_is_valid(ring, st.st_size)) {
+    if (ring)
+      munmap(ring, st.st_size);
+    errno = EINVAL;
+    return -1;
+  }
+
+  g_ring = ring;
+  g_ring_size = st.st_size;
+  logging_emitter = logging_emit_shm;
+  return 0;
+}
+
+static shm_ring_proc_t *logging_shm_proc()
+{
+  pid_t pid = getpid();
+  if (g_proc_pid == pid)
+    return &g_ring->procs[g_proc_index];
+
+  /* The last entry is shared by everyone once the table is full. */
+  int i;
+  for (i = 0; i < SHM_RING_MAX_PROCS - 1; i++) {
+    int32_t expected = 0;
+    if (__atomic_load_n(&g_ring->procs[i].pid, __ATOMIC_RELAXED) == pid ||
+        __atomic_compare_exchange_n(&g_ring->procs[i].pid, &expected, pid, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      break;
+  }
+
+  g_proc_index = i;
+  g_proc_pid = pid;
+  return &g_ring->procs[i];
+}
+
+/* Claims the next free slot for pid and sets *pos_p to its position.
+ * Returns NULL if the ring is full.
+ */
+static shm_ring_slot_t *logging_shm_claim(pid_t pid, uint64_t *pos_p)
+{
+  uint64_t pos = __atomic_load_n(&g_ring->head, __ATOMIC_RELAXED);
+  for (;;) {
+    shm_ring_slot_t *slot = SLOT(g_ring, pos);
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq == pos) {
+      if (__atomic_compare_exchange_n(&slot->seq, &seq,
+                                      SHM_SEQ_CLAIM(pos, pid), 0,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        __atomic_compare_exchange_n(&g_ring->head, &pos, pos + 1, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        *pos_p = pos;
+        return slot;
+      }
+    } else if (SHM_SEQ_IS_CLAIM(seq)) {
+      int32_t lap = (int32_t) (SHM_SEQ_CLAIM_POS(seq) - (uint32_t) pos);
+      if (lap < 0)
+        return NULL;  /* full, still claimed from the previous lap */
+      if (lap == 0)   /* claimed, move the head along for its writer */
+        __atomic_compare_exchange_n(&g_ring->head, &pos, pos + 1, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    } else if (seq < pos)
+      return NULL;  /* full */
+    pos = __atomic_load_n(&g_ring->head, __ATOMIC_RELAXED);
+  }
+}
+
+void logging_emit_shm(logging_record_t *rec_p)
+{
+  char buf[LOGGING_SHM_MAX_SLOT_SIZE];
+  strx_buf_t out;
+
+  strx_buf_init(&out, buf, g_ring->slot_size - SHM_SLOT_HEADER_SIZE);
+  logging_format_record(rec_p, logging_log_format, &out);
+
+  /* Even a truncated record should end the line. */
+  logging_end_truncated(&out);
+
+  uint64_t pos;
+  shm_ring_slot_t *slot = logging_shm_claim(getpid(), &pos);
+  if (slot == NULL) {
+    __atomic_fetch_add(&logging_shm_proc()->drops, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  slot->len = strx_buf_len(&out);
+  memcpy(slot->data, buf, slot->len);
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+unsigned long long logging_shm_drops(pid_t pid)
+{
+  unsigned long long drops = 0;
+  int i;
+  for (i = 0; g_ring && i < SHM_RING_MAX_PROCS; i++)
+    if (pid == 0 || g_ring->procs[i].pid == pid)
+      drops += __atomic_load_n(&g_ring->procs[i].drops, __ATOMIC_RELAXED);
+  return drops;
+}
+
+/* Collector side. */
+
+static int logging_shm_is_gone(pid_t pid)
+{
+  return kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+static void logging_shm_report_drops(strx_buf_t *out)
+{
+  static uint64_t last_reclaim = 0;
+  uint64_t now = monotonic_ns();
+  int reclaim = now - last_reclaim >= SHM_RECLAIM_INTERVAL_NS;
+  if (reclaim)
+    last_reclaim = now;
+
+  int i;
+  for (i = 0; i < SHM_RING_MAX_PROCS; i++) {
+    shm_ring_proc_t *proc = &g_ring->procs[i];
+    uint64_t drops = __atomic_load_n(&proc->drops, __ATOMIC_RELAXED);
+    pid_t pid = __atomic_load_n(&proc->pid, __ATOMIC_RELAXED);
+    if (drops != proc->reported) {
+      strx_buf_printf(out, "logging: dropped %llu records from process %d\n",
+                      (unsigned long long) (drops - proc->reported),
+                      (i == SHM_RING_MAX_PROCS - 1)? -1 : (int) pid);
+      proc->reported = drops;
+    } else if (reclaim && pid != 0 && logging_shm_is_gone(pid)) {
+      /* Reclaim the entry of a process that is gone. */
+      proc->drops = proc->reported = 0;
+      __atomic_store_n(&proc->pid, 0, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+size_t logging_shm_drain(int fd)
+{
+  static uint64_t stall_pos = UINT64_MAX, stall_since = 0;
+
+  char buf[65536];
+  strx_buf_t out;
+  strx_buf_init(&out, buf, sizeof(buf));
+
+  size_t count = 0;
+  uint64_t pos = g_ring->tail;
+
+  for (;;) {
+    shm_ring_slot_t *slot = SLOT(g_ring, pos);
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if (seq == pos + 1) {
+      if ((size_t) (out.end - out.cur - 1) < slot->len) {
+        logging_write_fully(fd, out.base, strx_buf_len(&out));
+        strx_buf_init(&out, buf, sizeof(buf));
+      }
+      strx_buf_putn(&out, slot->data, slot->len);
+      count++;
+    } else if (!SHM_SEQ_IS_CLAIM(seq))
+      break;  /* empty */
+    else {
+      /* Claimed but not committed.  Give up on the slot only if the
+       * writer is gone for good; a writer that is still around will
+       * commit the slot eventually.
+       */
+      uint64_t now = monotonic_ns();
+      if (stall_pos != pos) {
+        stall_pos = pos;
+        stall_since = now;
+        break;
+      }
+
+      pid_t pid = SHM_SEQ_CLAIM_PID(seq);
+      if (now - stall_since < SHM_STALL_TIMEOUT_NS ||
+          !logging_shm_is_gone(pid))
+        break;
+
+      strx_buf_printf(&out, "logging: lost a record from process %d\n",
+                      (int) pid);
+    }
+
+    __atomic_store_n(&slot->seq, pos + g_ring->num_slots, __ATOMIC_RELEASE);
+    pos++;
+  }
+
+  __atomic_store_n(&g_ring->tail, pos, __ATOMIC_RELAXED);
+
+  logging_shm_report_drops(&out);
+  logging_write_fully(fd, out.base, strx_buf_len(&out));
+  return count;
+}
+
+/* Drains the ring until *stop_p is set, or until the parent process
+ * changes if parent is not 0, then drains it one last time.
+ */
+static void logging_shm_collect_until(int fd, volatile sig_atomic_t *stop_p,
+                                      pid_t parent)
+{
+  struct timespec backoff = { 0, 1000000 };  /* 1 ms */
+
+  while (!*stop_p && (parent == 0 || getppid() == parent))
+    if (logging_shm_drain(fd) == 0)
+      nanosleep(&backoff, NULL);
+
+  logging_shm_drain(fd);
+}
+
+int logging_shm_collect(int fd, volatile sig_atomic_t *stop_p)
+{
+  if (g_ring == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  logging_shm_collect_until(fd, stop_p, 0);
+  return 0;
+}
+
+static volatile sig_atomic_t g_collector_stop = 0;
+
+static void logging_shm_collector_signal(int signo)
+{
+  (void) signo;
+  g_collector_stop = 1;
+}
+
+pid_t logging_shm_spawn_collector(int fd)
+{
+  if (g_ring == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pid_t parent = getpid();
+  pid_t pid = fork();
+  if (pid != 0)
+    return pid;  /* parent, or -1 */
+
+  signal(SIGTERM, logging_shm_collector_signal);
+  signal(SIGINT, SIG_IGN);  /* let the parent decide when to stop */
+
+  logging_shm_collect_until(fd, &g_collector_stop, parent);
+  _exit(0);
+}
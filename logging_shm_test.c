@@ -0,0 +1,172 @@
+/* Includes the ring itself, so that a writer can die holding a claim.
+ * The Makefile links it without logging_shm.o for that reason.
+ */
+#include "logging_shm.c"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define NUM_WRITERS     4
+#define NUM_RECORDS     2000
+
+static char g_name[64], g_log_file[64];
+
+static pid_t spawn(void (*child_main)(int), int arg)
+{
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    child_main(arg);
+    exit(0);
+  }
+  return pid;
+}
+
+/* Writes in bursts for about two seconds, past the dead claim. */
+static void writer_main(int w)
+{
+  int i;
+  for (i = 0; i < NUM_RECORDS; i++) {
+    INFO("writer %d record %d", w, i);
+    if (i % 100 == 99)
+      usleep(100000);
+  }
+}
+
+/* Dies between claiming a slot and committing it. */
+static void dead_writer_main(int arg)
+{
+  uint64_t pos;
+  (void) arg;
+  logging_shm_claim(getpid(), &pos);
+  _exit(0);
+}
+
+/* Attaching refuses an object that is not a ring, and a ring whose
+ * slots do not fit in the object.  Exits with the number of failures.
+ */
+static void attach_main(int arg)
+{
+  char name[64];
+  int failures = 0, res, fd;
+  (void) arg;
+
+  snprintf(name, sizeof(name), "/logging_shm_test.%d.bad", (int) getpid());
+  fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  res = ftruncate(fd, 65536) == -1 || logging_shm_attach(name) != -1 ||
+        errno != EINVAL;
+  printf("attach to zeros %s\n", res? "?" : "refused");
+  failures += res;
+  close(fd);
+  shm_unlink(name);
+
+  logging_shm_create(name, 64, 128);
+  fd = shm_open(name, O_RDWR, 0);
+  res = ftruncate(fd, 1024) == -1 || logging_shm_attach(name) != -1 ||
+        errno != EINVAL;
+  printf("attach to short ring %s\n", res? "?" : "refused");
+  failures += res;
+  close(fd);
+  shm_unlink(name);
+
+  fflush(stdout);
+  _exit(failures);
+}
+
+int main()
+{
+  snprintf(g_name, sizeof(g_name), "/logging_shm_test.%d", (int) getpid());
+  snprintf(g_log_file, sizeof(g_log_file),
+           "/tmp/logging_shm_test.%d", (int) getpid());
+
+  int failures = 0, w, status;
+
+  logging_ensure_initialized();
+
+  pid_t attacher = spawn(attach_main, 0);
+  waitpid(attacher, &status, 0);
+  failures += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+
+  if (logging_shm_create(g_name, 64, 128) == -1) {
+    perror(g_name);
+    return 1;
+  }
+
+  /* A named ring is never reinitialized. */
+  int res = logging_shm_create(g_name, 64, 128);
+  printf("second create %s\n", res == -1 && errno == EEXIST? "refused" : "?");
+  failures += !(res == -1 && errno == EEXIST);
+
+  FILE *log = fopen(g_log_file, "w+");
+  if (log == NULL) {
+    perror(g_log_file);
+    return 1;
+  }
+  pid_t collector = logging_shm_spawn_collector(fileno(log));
+
+  /* The dead claim holds up the collector for a second, so the writers
+   * overrun the ring before it is skipped.
+   */
+  pid_t dead = spawn(dead_writer_main, 0);
+  waitpid(dead, NULL, 0);
+
+  pid_t writers[NUM_WRITERS];
+  for (w = 0; w < NUM_WRITERS; w++)
+    writers[w] = spawn(writer_main, w);
+  for (w = 0; w < NUM_WRITERS; w++)
+    waitpid(writers[w], NULL, 0);
+
+  sleep(3);
+  kill(collector, SIGTERM);
+  waitpid(collector, NULL, 0);
+  logging_shm_unlink(g_name);
+
+  /* Each writer's records arrive in order, and every record is either
+   * received or reported dropped.
+   */
+  int next[NUM_WRITERS] = { 0 }, received[NUM_WRITERS] = { 0 };
+  unsigned long long dropped[NUM_WRITERS] = { 0 };
+  int lost = 0, out_of_order = 0;
+  char line[256];
+
+  rewind(log);
+  while (fgets(line, sizeof(line), log) != NULL) {
+    const char *p;
+    int i, pid;
+    unsigned long long n;
+    if ((p = strstr(line, "writer ")) != NULL &&
+        sscanf(p, "writer %d record %d", &w, &i) == 2 &&
+        w >= 0 && w < NUM_WRITERS) {
+      out_of_order += i < next[w];
+      next[w] = i + 1;
+      received[w]++;
+    } else if (sscanf(line, "logging: dropped %llu records from process %d",
+                      &n, &pid) == 2) {
+      for (w = 0; w < NUM_WRITERS; w++)
+        if (writers[w] == pid)
+          dropped[w] += n;
+    } else if (sscanf(line, "logging: lost a record from process %d",
+                      &pid) == 1)
+      lost += pid == dead;
+  }
+  fclose(log);
+  unlink(g_log_file);
+
+  unsigned long long total_dropped = 0;
+  for (w = 0; w < NUM_WRITERS; w++) {
+    printf("writer %d: received %d, dropped %llu of %d\n",
+           w, received[w], dropped[w], NUM_RECORDS);
+    failures += received[w] + dropped[w] != NUM_RECORDS;
+    total_dropped += dropped[w];
+  }
+  printf("out of order %d\n", out_of_order);
+  failures += out_of_order != 0;
+  failures += total_dropped == 0;
+  printf("lost %d from the dead writer\n", lost);
+  failures += lost != 1;
+
+  printf("%s\n", failures? "FAIL" : "PASS");
+  return failures != 0;
+}
@@ -0,0 +1,424 @@
+/* Batched syslog output over a Unix datagram socket.
+ * Copyright (C) 2009--2013  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Callers format RFC 5424 messages into a bounded queue of fixed size
+ * slots.  A sender thread hands whatever is queued to sendmmsg(), up
+ * to SYSLOG_BATCH messages per call, straight out of the slots.
+ *
+ * When the receiver goes away, the sender keeps the queue and tries to
+ * reconnect every SYSLOG_RECONNECT_INTERVAL.  When the receiver is
+ * slow, the sender blocks, the queue fills up, and callers drop their
+ * messages and count them rather than wait.  The sender reports the
+ * count in a message of its own once there is room again.
+ */
+
+#define _GNU_SOURCE     /* sendmmsg(), program_invocation_short_name */
+
+#include "logging.h"
+
+#include <errno.h>      /* errno, ECONNREFUSED, program_invocation_short_name */
+#include <poll.h>       /* poll() */
+#include <pthread.h>    /* pthread_create(), pthread_mutex_lock() */
+#include <stdlib.h>     /* atexit(), free(), malloc() */
+#include <string.h>     /* memcpy(), memset() */
+#include <sys/socket.h> /* connect(), send(), sendmmsg(), socket() */
+#include <sys/un.h>     /* struct sockaddr_un */
+#include <time.h>       /* clock_gettime(), gmtime_r(), nanosleep() */
+#include <unistd.h>     /* close(), gethostname(), getpid() */
+
+#define SYSLOG_QUEUE_SIZE               1024    /* messages */
+#define SYSLOG_MAX_MESSAGE_SIZE         2048
+#define SYSLOG_BATCH                    64
+#define SYSLOG_RECONNECT_INTERVAL       1.0     /* seconds */
+#define SYSLOG_FLUSH_TIMEOUT            1.0     /* seconds */
+#define SYSLOG_CRASH_TIMEOUT            1.0     /* seconds */
+
+#define SYSLOG_FACILITY_USER            1
+
+const char *logging_syslog_format = "%(message)s";
+
+typedef struct {
+  size_t len;
+  char data[SYSLOG_MAX_MESSAGE_SIZE];
+} syslog_message_t;
+
+/* Messages in [g_tail, g_head) are queued, indices modulo the size. */
+static syslog_message_t *g_queue = NULL;
+static unsigned long g_head = 0, g_tail = 0;
+static unsigned long long g_drops = 0, g_reported = 0;
+
+static pthread_mutex_t g_syslog_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_syslog_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_syslog_sent = PTHREAD_COND_INITIALIZER;
+
+/* Sender thread only, after logging_syslog_open(). */
+static int g_sock = -1;
+static struct sockaddr_un g_addr;
+
+static char g_hostname[256] = "-";
+static char g_app_name[49] = "-";
+
+#define QUEUE_SLOT(i) (&g_queue[(i) % SYSLOG_QUEUE_SIZE])
+
+/* Maps levelno to syslog severity: CRIT and above to crit (2), ERROR to
+ * err (3), WARN to warning (4), INFO to info (6), and below to debug (7).
+ */
+static int syslog_severity(int levelno)
+{
+  if (levelno >= LOG_CRIT)
+    return 2;
+  if (levelno >= LOG_ERROR)
+    return 3;
+  if (levelno >= LOG_WARN)
+    return 4;
+  if (levelno >= LOG_INFO)
+    return 6;
+  return 7;
+}
+
+static void strx_buf_putpadded(strx_buf_t *b, unsigned long x, int width)
+{
+  char digits[24];
+  char *p = strxfromull(digits, digits + sizeof(digits), x, 10, "0123456789");
+  if (p - digits < width)
+    strx_buf_putn(b, "000000000", width - (p - digits));
+  strx_buf_putn(b, digits, p - digits);
+}
+
+/* Appends the header fields after TIMESTAMP, up to and including the
+ * space before MSG.
+ */
+static void syslog_put_origin(strx_buf_t *b)
+{
+  strx_buf_puts(b, g_hostname);
+  strx_buf_putn(b, " ", 1);
+  strx_buf_puts(b, g_app_name);
+  strx_buf_putn(b, " ", 1);
+  strx_buf_putll(b, getpid());
+  strx_buf_putn(b, " - - ", 5);
+}
+
+/* Appends the header up to and including the space before MSG:
+ *
+ *   <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA
+ */
+static void syslog_put_header(strx_buf_t *b, int severity, double created)
+{
+  time_t t = (time_t) created;
+  struct tm tms;
+  gmtime_r(&t, &tms);
+
+  strx_buf_putn(b, "<", 1);
+  strx_buf_putll(b, SYSLOG_FACILITY_USER * 8 + severity);
+  strx_buf_putn(b, ">1 ", 3);
+  strx_buf_putpadded(b, tms.tm_year + 1900, 4);
+  strx_buf_putn(b, "-", 1);
+  strx_buf_putpadded(b, tms.tm_mon + 1, 2);
+  strx_buf_putn(b, "-", 1);
+  strx_buf_putpadded(b, tms.tm_mday, 2);
+  strx_buf_putn(b, "T", 1);
+  strx_buf_putpadded(b, tms.tm_hour, 2);
+  strx_buf_putn(b, ":", 1);
+  strx_buf_putpadded(b, tms.tm_min, 2);
+  strx_buf_putn(b, ":", 1);
+  strx_buf_putpadded(b, tms.tm_sec, 2);
+  strx_buf_putn(b, ".", 1);
+  strx_buf_putpadded(b, (unsigned long) ((created - t) * 1e6) % 1000000, 6);
+  strx_buf_putn(b, "Z ", 2);
+  syslog_put_origin(b);
+}
+
+static double realtime_double()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Must be called with g_syslog_lock held and room in the queue. */
+static void logging_syslog_report_drops_locked()
+{
+  syslog_message_t *m = QUEUE_SLOT(g_head);
+  strx_buf_t b;
+
+  strx_buf_init(&b, m->data, sizeof(m->data));
+  syslog_put_header(&b, syslog_severity(LOG_WARN), realtime_double());
+  strx_buf_putull(&b, g_drops - g_reported, 10, "0123456789");
+  strx_buf_puts(&b, " messages dropped");
+  m->len = strx_buf_len(&b);
+
+  g_reported = g_drops;
+  g_head++;
+}
+
+static int logging_syslog_connect()
+{
+  int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (sock == -1)
+    return -1;
+  if (connect(sock, (struct sockaddr *) &g_addr, sizeof(g_addr)) == -1) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+static int is_disconnect_error(int err)
+{
+  return err == ECONNREFUSED || err == ENOTCONN || err == ENOENT ||
+    err == EPIPE || err == ECONNRESET || err == EDESTADDRREQ;
+}
+
+static void *logging_syslog_sender(void *arg)
+{
+  (void) arg;
+
+  struct mmsghdr msgs[SYSLOG_BATCH];
+  struct iovec iovs[SYSLOG_BATCH];
+
+  pthread_mutex_lock(&g_syslog_lock);
+  for (;;) {
+    while (g_tail == g_head)
+      pthread_cond_wait(&g_syslog_queued, &g_syslog_lock);
+
+    unsigned int n = 0;
+    unsigned long i;
+    for (i = g_tail; i != g_head && n < SYSLOG_BATCH; i++, n++) {
+      syslog_message_t *m = QUEUE_SLOT(i);
+      iovs[n].iov_base = m->data;
+      iovs[n].iov_len = m->len;
+      memset(&msgs[n], 0, sizeof(msgs[n]));
+      msgs[n].msg_hdr.msg_iov = &iovs[n];
+      msgs[n].msg_hdr.msg_iovlen = 1;
+    }
+    pthread_mutex_unlock(&g_syslog_lock);
+
+    int sent = 0;
+    if (g_sock == -1 && (g_sock = logging_syslog_connect()) == -1) {
+      struct timespec ts = { (time_t) SYSLOG_RECONNECT_INTERVAL, 0 };
+      nanosleep(&ts, NULL);
+    } else if ((sent = sendmmsg(g_sock, msgs, n, 0)) == -1) {
+      sent = 0;
+      if (is_disconnect_error(errno)) {
+        close(g_sock);
+        g_sock = -1;
+      } else if (errno != EINTR)
+        sent = 1;  /* e.g. EMSGSIZE; skip the message */
+    }
+
+    pthread_mutex_lock(&g_syslog_lock);
+    g_tail += sent;
+    if (g_drops != g_reported && g_head - g_tail < SYSLOG_QUEUE_SIZE)
+      logging_syslog_report_drops_locked();
+    pthread_cond_broadcast(&g_syslog_sent);
+  }
+
+  return NULL;
+}
+
+void logging_emit_syslog(logging_record_t *rec_p)
+{
+  char buf[SYSLOG_MAX_MESSAGE_SIZE];
+  strx_buf_t b;
+
+  if (g_queue == NULL) {  /* set as the emitter without a queue */
+    logging_emit_stdlog(rec_p);
+    return;
+  }
+
+  strx_buf_init(&b, buf, sizeof(buf));
+  syslog_put_header(&b, syslog_severity(rec_p->levelno), rec_p->created);
+  logging_format_record(rec_p, logging_syslog_format, &b);
+  size_t len = strx_buf_len(&b);
+  if (len > 0 && buf[len - 1] == '\n')
+    len--;  /* a datagram is one record already */
+
+  pthread_mutex_lock(&g_syslog_lock);
+  if (g_head - g_tail >= SYSLOG_QUEUE_SIZE)
+    g_drops++;
+  else {
+    syslog_message_t *m = QUEUE_SLOT(g_head);
+    memcpy(m->data, buf, len);
+    m->len = len;
+    if (g_head++ == g_tail)
+      pthread_cond_signal(&g_syslog_queued);
+  }
+  pthread_mutex_unlock(&g_syslog_lock);
+}
+
+void logging_syslog_flush()
+{
+  if (g_queue == NULL)
+    return;
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += (time_t) SYSLOG_FLUSH_TIMEOUT;
+
+  pthread_mutex_lock(&g_syslog_lock);
+  while (g_tail != g_head &&
+         pthread_cond_timedwait(&g_syslog_sent, &g_syslog_lock, &deadline)
+         != ETIMEDOUT)
+    ;
+  pthread_mutex_unlock(&g_syslog_lock);
+}
+
+/* Waits until sock can take another message, but not past deadline.
+ * Only uses async-signal-safe calls.
+ */
+static int syslog_wait_writable(int sock, const struct timespec *deadline)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long ms = (deadline->tv_sec - now.tv_sec) * 1000 +
+            (deadline->tv_nsec - now.tv_nsec) / 1000000;
+  if (ms <= 0)
+    return -1;
+
+  struct pollfd pfd = { sock, POLLOUT, 0 };
+  return (poll(&pfd, 1, ms) == 1)? 0 : -1;
+}
+
+int logging_syslog_crash_drain(const char *final, size_t len)
+{
+  if (g_queue == NULL)
+    return -1;
+
+  int sock = g_sock;
+  if (sock == -1 && (sock = logging_syslog_connect()) == -1)
+    return -1;
+
+  /* A receiver that does not keep up gets SYSLOG_CRASH_TIMEOUT in all
+   * before the rest is given up.
+   */
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += (time_t) SYSLOG_CRASH_TIMEOUT;
+
+  /* The sender thread may be sending the same messages; sending them
+   * twice is better than losing them.
+   */
+  struct mmsghdr msgs[SYSLOG_BATCH];
+  struct iovec iovs[SYSLOG_BATCH];
+  unsigned long i = __atomic_load_n(&g_tail, __ATOMIC_ACQUIRE);
+  unsigned long head = __atomic_load_n(&g_head, __ATOMIC_ACQUIRE);
+  if (head - i > SYSLOG_QUEUE_SIZE)
+    i = head - SYSLOG_QUEUE_SIZE;
+  while (i != head) {
+    unsigned int n = 0;
+    unsigned long j;
+    for (j = i; j != head && n < SYSLOG_BATCH; j++, n++) {
+      syslog_message_t *m = QUEUE_SLOT(j);
+      iovs[n].iov_base = m->data;
+      iovs[n].iov_len = m->len;
+      memset(&msgs[n], 0, sizeof(msgs[n]));
+      msgs[n].msg_hdr.msg_iov = &iovs[n];
+      msgs[n].msg_hdr.msg_iovlen = 1;
+    }
+    int sent = sendmmsg(sock, msgs, n, MSG_DONTWAIT);
+    if (sent > 0)
+      i += sent;
+    else if (is_disconnect_error(errno))
+      break;
+    else if (errno != EAGAIN && errno != EINTR)
+      i++;  /* e.g. EMSGSIZE; skip the message */
+    if (sent < (int) n && syslog_wait_writable(sock, &deadline) == -1)
+      break;
+  }
+
+  /* gmtime_r() is not async-signal-safe, so the final message has no
+   * TIMESTAMP of its own; final carries one.
+   */
+  char buf[512];
+  strx_buf_t b;
+  strx_buf_init(&b, buf, sizeof(buf));
+  strx_buf_putn(&b, "<", 1);
+  strx_buf_putll(&b, SYSLOG_FACILITY_USER * 8 + syslog_severity(LOG_CRIT));
+  strx_buf_putn(&b, ">1 - ", 5);
+  syslog_put_origin(&b);
+  if (len > 0 && final[len - 1] == '\n')
+    len--;
+  strx_buf_putn(&b, final, len);
+  while (send(sock, buf, strx_buf_len(&b), MSG_DONTWAIT) == -1 &&
+         errno == EAGAIN && syslog_wait_writable(sock, &deadline) == 0)
+    ;
+
+  if (sock != g_sock)
+    close(sock);
+  return 0;
+}
+
+unsigned long long logging_syslog_drops()
+{
+  pthread_mutex_lock(&g_syslog_lock);
+  unsigned long long drops = g_drops;
+  pthread_mutex_unlock(&g_syslog_lock);
+  return drops;
+}
+
+int logging_syslog_open(const char *path, const char *app_name)
+{
+  if (g_queue != NULL)
+    return -1;
+
+  if (path == NULL)
+    path = "/dev/log";
+  if (app_name == NULL)
+    app_name = program_invocation_short_name;
+
+  memset(&g_addr, 0, sizeof(g_addr));
+  g_addr.sun_family = AF_UNIX;
+  strxcpy(g_addr.sun_path, g_addr.sun_path + sizeof(g_addr.sun_path),
+          path, SIZE_MAX);
+  if ((g_sock = logging_syslog_connect()) == -1)
+    return -1;
+
+  /* RFC 5424 header fields are printable ASCII without spaces; an
+   * empty or unknown value is "-".
+   */
+  if (gethostname(g_hostname, sizeof(g_hostname)) == -1 || !*g_hostname)
+    strxcpy(g_hostname, g_hostname + sizeof(g_hostname), "-", 1);
+  strxcpy(g_app_name, g_app_name + sizeof(g_app_name), app_name, SIZE_MAX);
+  if (!*g_app_name)
+    strxcpy(g_app_name, g_app_name + sizeof(g_app_name), "-", 1);
+  char *p;
+  for (p = g_app_name; *p; p++)
+    if (*p <= ' ' || *p > '~')
+      *p = '_';
+
+  g_queue = (syslog_message_t *)
+    malloc(SYSLOG_QUEUE_SIZE * sizeof(syslog_message_t));
+  if (g_queue == NULL) {
+    close(g_sock);
+    g_sock = -1;
+    return -1;
+  }
+
+  pthread_t sender;
+  if (pthread_create(&sender, NULL, logging_syslog_sender, NULL) != 0) {
+    free(g_queue);
+    g_queue = NULL;
+    close(g_sock);
+    g_sock = -1;
+    return -1;
+  }
+  pthread_detach(sender);
+
+  atexit(logging_syslog_flush);
+  logging_emitter = logging_emit_syslog;
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include "logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static struct sockaddr_un g_addr;
+
+static int listen_syslog()
+{
+  int sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+  unlink(g_addr.sun_path);
+  if (sock == -1 ||
+      bind(sock, (struct sockaddr *) &g_addr, sizeof(g_addr)) == -1) {
+    perror(g_addr.sun_path);
+    return -1;
+  }
+  return sock;
+}
+
+/* Receives messages until expected of them start with prefix and end
+ * with suffix, or for up to timeout_ms of idle time.
+ */
+static int receive(int sock, int expected, int timeout_ms,
+                   const char *prefix, const char *suffix)
+{
+  char buf[4096];
+  int matched = 0;
+  int waited;
+
+  for (waited = 0; waited < timeout_ms && matched < expected; ) {
+    ssize_t n = recv(sock, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+    if (n == -1) {
+      usleep(10000);
+      waited += 10;
+      continue;
+    }
+    waited = 0;
+    buf[n] = '\0';
+    size_t suffix_len = strlen(suffix);
+    if (strncmp(buf, prefix, strlen(prefix)) == 0 &&
+        (size_t) n >= suffix_len && strcmp(buf + n - suffix_len, suffix) == 0)
+      matched++;
+  }
+
+  return matched;
+}
+
+int main()
+{
+  g_addr.sun_family = AF_UNIX;
+  snprintf(g_addr.sun_path, sizeof(g_addr.sun_path),
+           "/tmp/logging_syslog_test.%d", (int) getpid());
+
+  int sock = listen_syslog();
+  if (sock == -1 || logging_syslog_open(g_addr.sun_path, "test") == -1)
+    return 1;
+
+  int failures = 0, i;
+
+  /* Severity mapping and batching. */
+  for (i = 0; i < 100; i++)
+    INFO("i = %d", i);
+  ERROR("error");
+  int got = receive(sock, 100, 2000, "<14>1 ", "");
+  got += receive(sock, 1, 2000, "<11>1 ", " - - error");
+  printf("received %d of 101\n", got);
+  failures += got != 101;
+
+  /* Reconnect after the receiver restarts. */
+  close(sock);
+  for (i = 0; i < 10; i++)
+    WARN("while away %d", i);
+  usleep(100000);
+  sock = listen_syslog();
+  got = receive(sock, 10, 5000, "<12>1 ", "");
+  printf("received %d of 10 after reconnect\n", got);
+  failures += got != 10;
+
+  /* A child without the sender thread, so that its messages stay queued
+   * until the crash handler drains them.
+   */
+  usleep(100000);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    logging_install_crash_handler();
+    for (i = 0; i < 50; i++)
+      INFO("queued %d", i);
+    abort();
+  }
+  got = receive(sock, 50, 2000, "<14>1 ", "");
+  got += receive(sock, 1, 2000, "<10>1 - ", "caught SIGABRT");
+  waitpid(pid, NULL, 0);
+  printf("received %d of 51 after a crash\n", got);
+  failures += got != 51;
+
+  /* Bounded backlog while the receiver is not reading. */
+  for (i = 0; i < 5000; i++)
+    INFO("flood %d", i);
+  unsigned long long drops = logging_syslog_drops();
+  printf("dropped %llu of 5000\n", drops);
+  failures += drops == 0;
+  got = receive(sock, 1, 5000, "<12>1 ", " messages dropped");
+  printf("received %d drop report\n", got);
+  failures += got != 1;
+
+  unlink(g_addr.sun_path);
+  printf("%s\n", failures? "FAIL" : "PASS");
+  return failures != 0;
+}
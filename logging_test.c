@@ -1,5 +1,34 @@
 #include "logging.h"
 
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Logs msg into a scratch stdlog and returns the line it came out as. */
+static const char *logged(const char *msg)
+{
+  static char line[4096];
+
+  rewind(stdlog);
+  if (ftruncate(fileno(stdlog), 0) == -1)
+    return "";
+  INFO("%s", msg);
+  fflush(stdlog);
+  rewind(stdlog);
+  if (fgets(line, sizeof(line), stdlog) == NULL)
+    return "";
+  line[strcspn(line, "\n")] = '\0';
+  return line;
+}
+
+static int expect(const char *what, const char *got, const char *expected)
+{
+  int failed = strcmp(got, expected) != 0;
+  printf("%s: %s%s%s\n", what, got, failed? " != " : "",
+         failed? expected : "");
+  return failed;
+}
+
 int main()
 {
   int i;
@@ -8,5 +37,65 @@ int main()
 
   DEBUG_EXPR("%d", i);
 
-  return 0;
+  FILE *saved_stdlog = stdlog;
+  stdlog = tmpfile();
+  if (stdlog == NULL) {
+    perror("tmpfile");
+    return 1;
+  }
+  logging_log_format = "%(context)s|%(context_json)s|%(message)s";
+
+  int failures = 0;
+
+  failures += expect("empty", logged("m"), "||m");
+
+  logging_context_push("request", "r-1");
+  logging_context_push("tenant", "t-1");
+  failures += expect("nested", logged("m"),
+                     "request=r-1 tenant=t-1|"
+                     ",\"request\":\"r-1\",\"tenant\":\"t-1\"|m");
+
+  logging_context_pop();
+  failures += expect("popped", logged("m"),
+                     "request=r-1|,\"request\":\"r-1\"|m");
+
+  logging_context_push("quote", "a\"b\\c\t");
+  failures += expect("escaped", logged("m"),
+                     "request=r-1 quote=a\"b\\c\t|"
+                     ",\"request\":\"r-1\",\"quote\":\"a\\\"b\\\\c\\u0009\"|m");
+  logging_context_pop();
+
+  /* Failed pushes leave the context as it was. */
+  const char *before = "request=r-1|,\"request\":\"r-1\"|m";
+
+  char big[LOGGING_CONTEXT_SIZE + 1];
+  memset(big, 'v', sizeof(big) - 1);
+  big[sizeof(big) - 1] = '\0';
+  int res = logging_context_push("big", big);
+  failures += res != -1;
+  failures += expect("too big", logged("m"), before);
+
+  /* Fits as is, but not with JSON escapes. */
+  memset(big, '"', LOGGING_CONTEXT_SIZE * 2 / 3);
+  big[LOGGING_CONTEXT_SIZE * 2 / 3] = '\0';
+  res = logging_context_push("quotes", big);
+  failures += res != -1;
+  failures += expect("escapes too big", logged("m"), before);
+
+  for (i = 1; i < LOGGING_CONTEXT_MAX_DEPTH; i++)
+    failures += logging_context_push("k", "v") != 0;
+  res = logging_context_push("deep", "v");
+  failures += res != -1;
+  for (i = 1; i < LOGGING_CONTEXT_MAX_DEPTH; i++)
+    logging_context_pop();
+  failures += expect("too deep", logged("m"), before);
+
+  logging_context_pop();
+  failures += expect("all popped", logged("m"), "||m");
+
+  fclose(stdlog);
+  stdlog = saved_stdlog;
+
+  printf("%s\n", failures? "FAIL" : "PASS");
+  return failures != 0;
 }
@@ -0,0 +1,195 @@
+/* Decompresses log files written by logging_lz_start().
+ * Copyright (C) 2009--2013  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Usage: logging_unlz [file ...]
+ *
+ * Writes the records of each file, or of standard input, to standard
+ * output.  A frame that is damaged, or torn because the fatal signal
+ * handler wrote out blocks over a frame the writer thread had only
+ * half written, is skipped with a warning: decoding resumes at the next
+ * frame header whose lengths are sane and whose checksum matches.  The
+ * exit status is 1 if anything was skipped.
+ */
+
+#define _GNU_SOURCE     /* memmem() */
+
+#include "logging.h"
+
+#include <stdint.h>     /* uint32_t */
+#include <stdio.h>      /* fopen(), fread(), fwrite() */
+#include <stdlib.h>     /* malloc() */
+#include <string.h>     /* memcmp(), memmem(), memmove() */
+
+/* A block written by the fatal signal handler has a final record
+ * appended to it, hence the slack.
+ */
+#define MAX_RAW_LEN     (LOGGING_LZ_MAX_BLOCK_SIZE + 4096)
+
+/* A window of the input, large enough to hold any one frame. */
+typedef struct {
+  FILE *in;
+  unsigned char *buf;
+  size_t size;
+  size_t start, end;            /* unread part of buf */
+  unsigned long long offset;    /* of buf[0] in the input */
+  int eof;
+} input_t;
+
+static uint32_t read32(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Reads ahead until need bytes are available, and returns how many are,
+ * fewer only at the end of the input.
+ */
+static size_t input_fill(input_t *in, size_t need)
+{
+  if (in->start > 0 && in->end - in->start < need) {
+    memmove(in->buf, in->buf + in->start, in->end - in->start);
+    in->offset += in->start;
+    in->end -= in->start;
+    in->start = 0;
+  }
+  while (in->end - in->start < need && !in->eof) {
+    size_t n = fread(in->buf + in->end, 1, in->size - in->end, in->in);
+    if (n == 0)
+      in->eof = 1;
+    in->end += n;
+  }
+  return in->end - in->start;
+}
+
+/* Skips to the next frame magic after the current position.  Returns
+ * the number of bytes skipped.
+ */
+static unsigned long long resync(input_t *in)
+{
+  unsigned long long from = in->offset + in->start;
+  in->start++;
+  for (;;) {
+    size_t avail = input_fill(in, 4);
+    const unsigned char *p = (const unsigned char *)
+      memmem(in->buf + in->start, avail, LOGGING_LZ_MAGIC, 4);
+    if (p != NULL) {
+      in->start = p - in->buf;
+      break;
+    }
+    if (in->eof) {
+      in->start = in->end;
+      break;
+    }
+    if (avail > 3)
+      in->start = in->end - 3;  /* the magic may straddle the refill */
+    input_fill(in, in->size / 2);
+  }
+  return in->offset + in->start - from;
+}
+
+/* Decodes the frame at the current position into raw, and returns its
+ * length, or NULL with *why_p set if it is not a good frame.
+ */
+static const char *decode(input_t *in, char *raw, size_t *len_p)
+{
+  size_t avail = input_fill(in, LOGGING_LZ_HEADER_SIZE);
+  const unsigned char *header = in->buf + in->start;
+  if (avail < LOGGING_LZ_HEADER_SIZE)
+    return "truncated header";
+  if (memcmp(header, LOGGING_LZ_MAGIC, 4) != 0)
+    return "bad magic";
+
+  uint32_t raw_len = read32(header + 4), comp_len = read32(header + 8);
+  uint32_t sum = read32(header + 12);
+  size_t len = comp_len? comp_len : raw_len;
+  if (raw_len > MAX_RAW_LEN ||
+      comp_len > logging_lz_bound(LOGGING_LZ_MAX_BLOCK_SIZE))
+    return "bad length";
+  if (input_fill(in, LOGGING_LZ_HEADER_SIZE + len)
+      < LOGGING_LZ_HEADER_SIZE + len)
+    return "truncated";
+
+  header = in->buf + in->start;
+  const unsigned char *data = header + LOGGING_LZ_HEADER_SIZE;
+  if (comp_len == 0)
+    memcpy(raw, data, raw_len);
+  else if (logging_lz_decompress(raw, raw_len, data, comp_len)
+           != (ssize_t) raw_len)
+    return "corrupt";
+  if (logging_lz_checksum(LOGGING_LZ_CHECKSUM_INIT, raw, raw_len) != sum)
+    return "bad checksum";
+
+  in->start += LOGGING_LZ_HEADER_SIZE + len;
+  *len_p = raw_len;
+  return NULL;
+}
+
+static int unlz(input_t *in, const char *name, char *raw)
+{
+  int status = 0;
+
+  while (input_fill(in, 1) > 0) {
+    unsigned long long offset = in->offset + in->start;
+    size_t raw_len;
+    const char *why = decode(in, raw, &raw_len);
+    if (why == NULL) {
+      fwrite(raw, raw_len, 1, stdout);
+      continue;
+    }
+
+    unsigned long long skipped = resync(in);
+    fprintf(stderr, "%s: offset %llu: %s, skipped %llu bytes\n",
+            name, offset, why, skipped);
+    status = -1;
+  }
+
+  return status;
+}
+
+int main(int argc, char **argv)
+{
+  input_t in;
+  in.size = LOGGING_LZ_HEADER_SIZE +
+    (MAX_RAW_LEN > logging_lz_bound(LOGGING_LZ_MAX_BLOCK_SIZE)?
+     MAX_RAW_LEN : logging_lz_bound(LOGGING_LZ_MAX_BLOCK_SIZE));
+  in.buf = (unsigned char *) malloc(in.size);
+  char *raw = (char *) malloc(MAX_RAW_LEN);
+  if (in.buf == NULL || raw == NULL) {
+    perror("malloc");
+    return 1;
+  }
+
+  int status = 0;
+  int i;
+  for (i = (argc < 2)? 0 : 1; i < argc; i++) {
+    const char *name = (i == 0)? "(stdin)" : argv[i];
+    in.in = (i == 0)? stdin : fopen(argv[i], "rb");
+    if (in.in == NULL) {
+      perror(argv[i]);
+      status = 1;
+      continue;
+    }
+    in.start = in.end = 0;
+    in.offset = 0;
+    in.eof = 0;
+    if (unlz(&in, name, raw) == -1)
+      status = 1;
+    if (i > 0)
+      fclose(in.in);
+  }
+
+  return status;
+}
@@ -18,12 +18,13 @@
 #define _GNU_SOURCE  /* strnlen() */
 
 #include <assert.h>     /* assert() */
+#include <math.h>       /* fma(), frexp(), isinf(), isnan(), ldexp(), signbit() */
 #include <stdarg.h>     /* va_list, va_start(), va_end() */
 #include <stddef.h>     /* ptrdiff_t */
-#include <stdint.h>     /* intmax_t, SIZE_MAX */
+#include <stdint.h>     /* intmax_t, uint32_t, uint64_t, SIZE_MAX */
 #include <stdio.h>      /* vsnprintf() */
 #include <stdlib.h>     /* abort(), strtoul() */
-#include <string.h>     /* strlen() */
+#include <string.h>     /* memcpy(), strlen(), strnlen() */
 
 #include "stringx.h"
 
@@ -36,6 +37,32 @@ char *strxcpy(char *dest, const char *dest_end, const char *src, size_t n) {
   return dest;
 }
 
+char *strxcpyv(char *dest, const char *dest_end,
+               const strx_iovec_t *iov, size_t iovcnt, size_t *fit_p) {
+  size_t avail = dest_end - dest - 1;
+  size_t i;
+  for (i = 0; i < iovcnt; i++) {
+    size_t len = iov[i].len;
+    if (len == STRX_NTS)
+      len = strnlen(iov[i].base, avail + 1);
+
+    if (len > avail) {  /* partial copy, and the buffer is now full */
+      memcpy(dest, iov[i].base, avail);
+      dest += avail;
+      break;
+    }
+
+    memcpy(dest, iov[i].base, len);
+    dest += len;
+    avail -= len;
+  }
+  *dest = '\0';
+
+  if (fit_p)
+    *fit_p = i;
+  return dest;
+}
+
 char *strxfromull(char *dest, const char *dest_end,
                   unsigned long long int x, int base, const char *digits) {
   assert(base >= 8 && base <= 16);
@@ -59,6 +86,202 @@ char *strxfromull(char *dest, const char *dest_end,
   return dest;
 }
 
+/* Powers of ten that are exactly representable in unsigned long long,
+ * hence the limit on the precision of strxfromd().
+ */
+static const unsigned long long int k_pow10[] = {
+  1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+  10000000ull, 100000000ull, 1000000000ull,
+};
+
+#define STRXFROMD_MAX_PREC 9
+
+/* The slow path of strxfromd(), for large magnitudes and precisions.
+ * x is m * 2^e exactly, so x * 10^prec is m * 10^prec * 2^e, which is
+ * computed in 32-bit limbs, least significant first, and rounded to
+ * nearest, ties to even, on the bits shifted out.  No double has more
+ * than STRXFROMD_EXACT_PREC significant digits after the point, so
+ * further digits are zeros.
+ */
+
+#define STRXFROMD_EXACT_PREC 1074
+#define STRXFROMD_LIMBS \
+  ((53 + 1024 + STRXFROMD_EXACT_PREC * 10 / 3) / 32 + 2)
+
+static void big_mul_small(uint32_t *n, size_t *len_p, uint32_t x) {
+  uint64_t carry = 0;
+  size_t i;
+  for (i = 0; i < *len_p; i++) {
+    carry += (uint64_t) n[i] * x;
+    n[i] = (uint32_t) carry;
+    carry >>= 32;
+  }
+  if (carry)
+    n[(*len_p)++] = (uint32_t) carry;
+}
+
+static void big_shift_left(uint32_t *n, size_t *len_p, unsigned int s) {
+  size_t words = s / 32, i;
+  unsigned int bits = s % 32;
+
+  n[*len_p] = 0;
+  for (i = *len_p + 1; i-- > 0; )
+    n[i + words] = (bits && i > 0)?
+      (n[i] << bits) | (n[i - 1] >> (32 - bits)) : n[i] << bits;
+  for (i = 0; i < words; i++)
+    n[i] = 0;
+  *len_p += words + 1;
+  while (*len_p > 0 && n[*len_p - 1] == 0)
+    --*len_p;
+}
+
+/* Shifts right by s > 0 bits, rounding to nearest, ties to even. */
+static void big_shift_right_round(uint32_t *n, size_t *len_p, unsigned int s) {
+  size_t words = s / 32, half_word = (s - 1) / 32, i;
+  unsigned int bits = s % 32, half_bit = (s - 1) % 32;
+
+  int half = 0, sticky = 0;
+  for (i = 0; i < half_word && i < *len_p; i++)
+    sticky |= n[i] != 0;
+  if (half_word < *len_p) {
+    half = (n[half_word] >> half_bit) & 1;
+    sticky |= (n[half_word] & ((1u << half_bit) - 1)) != 0;
+  }
+
+  size_t len = (words < *len_p)? *len_p - words : 0;
+  for (i = 0; i < len; i++)
+    n[i] = (bits && i + words + 1 < *len_p)?
+      (n[i + words] >> bits) | (n[i + words + 1] << (32 - bits)) :
+      n[i + words] >> bits;
+  while (len > 0 && n[len - 1] == 0)
+    --len;
+
+  if (half && (sticky || (len > 0 && (n[0] & 1)))) {
+    for (i = 0; i < len && ++n[i] == 0; i++)
+      ;
+    if (i == len)
+      n[len++] = 1;
+  }
+  *len_p = len;
+}
+
+static uint32_t big_divmod_small(uint32_t *n, size_t *len_p, uint32_t x) {
+  uint64_t rem = 0;
+  size_t i;
+  for (i = *len_p; i-- > 0; ) {
+    rem = (rem << 32) | n[i];
+    n[i] = (uint32_t) (rem / x);
+    rem %= x;
+  }
+  while (*len_p > 0 && n[*len_p - 1] == 0)
+    --*len_p;
+  return (uint32_t) rem;
+}
+
+static char *strxfromd_exact(char *dest, const char *dest_end,
+                             double x, int prec) {
+  int e, zeros = 0;
+  unsigned long long int m = (unsigned long long int) ldexp(frexp(x, &e), 53);
+  e -= 53;
+
+  if (prec > STRXFROMD_EXACT_PREC) {
+    zeros = prec - STRXFROMD_EXACT_PREC;
+    prec = STRXFROMD_EXACT_PREC;
+  }
+
+  uint32_t n[STRXFROMD_LIMBS];
+  size_t len = 2, k;
+  n[0] = (uint32_t) m;
+  n[1] = (uint32_t) (m >> 32);
+  for (k = prec; k > 0; k -= (k < 9)? k : 9)
+    big_mul_small(n, &len, k_pow10[(k < 9)? k : 9]);
+  while (len > 0 && n[len - 1] == 0)
+    --len;
+  if (e > 0)
+    big_shift_left(n, &len, e);
+  else if (e < 0)
+    big_shift_right_round(n, &len, -e);
+
+  /* Nine digits at a time, from the right, then at least one digit
+   * before the point.
+   */
+  char digits[STRXFROMD_LIMBS * 10];
+  char *end = digits + sizeof(digits), *start = end;
+  do {
+    uint32_t chunk = big_divmod_small(n, &len, 1000000000u);
+    for (k = 0; k < 9; k++, chunk /= 10)
+      *--start = '0' + chunk % 10;
+  } while (len > 0);
+  while (end - start > prec + 1 && *start == '0')
+    start++;
+  while (end - start < prec + 1)
+    *--start = '0';
+
+  dest = strxcpy(dest, dest_end, start, end - start - prec);
+  if (prec == 0 && zeros == 0)
+    return dest;
+  dest = strxcpy(dest, dest_end, ".", 1);
+  dest = strxcpy(dest, dest_end, end - prec, prec);
+  for ( ; zeros > 0 && dest < dest_end - 1; zeros -= 9)
+    dest = strxcpy(dest, dest_end, "000000000", (zeros < 9)? zeros : 9);
+  return dest;
+}
+
+char *strxfromd(char *dest, const char *dest_end, double x, int prec) {
+  static const char *digits = "0123456789";
+
+  if (isnan(x))
+    return strxcpy(dest, dest_end, "nan", 3);
+
+  if (signbit(x)) {
+    dest = strxcpy(dest, dest_end, "-", 1);
+    x = -x;
+  }
+
+  if (isinf(x))
+    return strxcpy(dest, dest_end, "inf", 3);
+
+  if (prec < 0)
+    prec = 0;
+
+  /* Beyond what fits in fixed point, convert exactly. */
+  if (prec > STRXFROMD_MAX_PREC || x >= 1e18)
+    return strxfromd_exact(dest, dest_end, x, prec);
+
+  /* Rounds to nearest, ties to even, on the exact binary value like the
+   * C library does.  x - ipart is exact, and so is the product of the
+   * fraction and the scale as the unevaluated sum hi + lo.  The
+   * remainder hi - fpart - 0.5 is exact too, and a multiple of the ulp
+   * of hi, which is more than |lo|; so only when it is 0 does lo decide.
+   */
+  unsigned long long int scale = k_pow10[prec];
+  unsigned long long int ipart = (unsigned long long int) x;
+  double frac = x - (double) ipart;
+  double hi = frac * (double) scale;
+  double lo = fma(frac, (double) scale, -hi);
+  unsigned long long int fpart = (unsigned long long int) hi;
+  double rem = (hi - (double) fpart) - 0.5;
+  if (rem > 0.0 || (rem == 0.0 &&
+                    (lo > 0.0 || (lo == 0.0 &&
+                                  ((prec? fpart : ipart) & 1)))))
+    fpart++;
+  if (fpart >= scale) {  /* rounded up into the integer part */
+    ipart++;
+    fpart -= scale;
+  }
+
+  dest = strxfromull(dest, dest_end, ipart, 10, digits);
+  if (prec == 0)
+    return dest;
+
+  dest = strxcpy(dest, dest_end, ".", 1);
+
+  char buf[STRXFROMD_MAX_PREC + 1];
+  char *p = strxfromull(buf, buf + sizeof(buf), fpart, 10, digits);
+  dest = strxcpy(dest, dest_end, "000000000", prec - (p - buf));
+  return strxcpy(dest, dest_end, buf, p - buf);
+}
+
 char *vsxprintf(char *dest, const char *dest_end,
                 const char *fmt, va_list ap) {
   const char *stop = dest_end - 1;
@@ -81,6 +304,7 @@ char *vsxprintf(char *dest, const char *dest_end,
 
     if (c == '%') {
       *dest++ = '%';
+      ++fmt;
       continue;
     }
 
@@ -112,6 +336,10 @@ char *vsxprintf(char *dest, const char *dest_end,
       c = *++fmt;
     }
 
+    /* Flags and vector separators are recognized but not yet honored. */
+    (void) alt; (void) zero; (void) negw; (void) spc; (void) plus; (void) dec;
+    (void) sep;
+
     char *next_fmt;
 
     char width = strtoul(fmt, &next_fmt, 10);
@@ -120,12 +348,13 @@ char *vsxprintf(char *dest, const char *dest_end,
     fmt = next_fmt;
     c = *fmt;
 
-    char prec = 0;
-    if (c == '.') {  /* ignore precision */
+    int prec = -1;
+    if (c == '.') {  /* only honored by floating point conversion */
       prec = strtoul(fmt + 1, &next_fmt, 10);
       fmt = next_fmt;
       c = *fmt;
     }
+    (void) width;  /* not yet honored either */
 
     /* parse length modifier */
 
@@ -183,7 +412,8 @@ char *vsxprintf(char *dest, const char *dest_end,
     case 'o': sign = 0; base = 8; break;
     case 'u': sign = 0; base = 10; break;
 
-    case 'X': digits = "0123456789ABCDEF";  /* followed by 'x' */
+    case 'X': digits = "0123456789ABCDEF";
+      /* fall through */
     case 'x': sign = 0; base = 16; break;
 
     case 'D': len = sizeof(long int); sign = 1; base = 10; break;
@@ -199,25 +429,33 @@ char *vsxprintf(char *dest, const char *dest_end,
     }
 
     if (convert) {
-      long long int x;
-      switch (len) {
-      case sizeof(int8_t): x = va_arg(ap, int /* promoted */); break;
-      case sizeof(int16_t): x = va_arg(ap, int /* promoted */); break;
-      case sizeof(int32_t): x = va_arg(ap, int32_t); break;
-      case sizeof(int64_t): x = va_arg(ap, int64_t); break;
-      default: abort();
-      }
-
+      unsigned long long int x;
       if (sign) {
-        if (x < 0) {
+        long long int y;
+        switch (len) {
+        case sizeof(int8_t): y = (int8_t) va_arg(ap, int /* promoted */); break;
+        case sizeof(int16_t): y = (int16_t) va_arg(ap, int /* promoted */); break;
+        case sizeof(int32_t): y = va_arg(ap, int32_t); break;
+        case sizeof(int64_t): y = va_arg(ap, int64_t); break;
+        default: abort();
+        }
+
+        if (y < 0) {
           *dest++ = '-';
           if (dest >= stop) break;
         }
-        x = -x;
+        x = (y < 0)? -(unsigned long long int) y : (unsigned long long int) y;
+      } else {
+        switch (len) {
+        case sizeof(int8_t): x = (uint8_t) va_arg(ap, int /* promoted */); break;
+        case sizeof(int16_t): x = (uint16_t) va_arg(ap, int /* promoted */); break;
+        case sizeof(int32_t): x = va_arg(ap, uint32_t); break;
+        case sizeof(int64_t): x = va_arg(ap, uint64_t); break;
+        default: abort();
+        }
       }
 
-      dest = strxfromull(
-          dest, dest_end, (unsigned long long int) x, base, digits);
+      dest = strxfromull(dest, dest_end, x, base, digits);
       continue;
     }
 
@@ -226,7 +464,12 @@ char *vsxprintf(char *dest, const char *dest_end,
     char cap = c >= 'A' && c <= 'Z';
     char style = cap? c - 'A' + 'a' : c;  /* tolower */
 
-    if (style == 'a' || style == 'e' || style == 'f' || style == 'g') {
+    if (style == 'f') {
+      dest = strxfromd(dest, dest_end, va_arg(ap, double), (prec < 0)? 6 : prec);
+      continue;
+    }
+
+    if (style == 'a' || style == 'e' || style == 'g') {
       (void) va_arg(ap, double);
       dest = strxcpy(dest, dest_end, "<double>", SIZE_MAX);  /* placeholder */
       continue;
@@ -275,3 +518,78 @@ char *snxprintf(char *dest, const char *dest_end, const char *fmt, ...) {
   va_end(ap);
   return res;
 }
+
+void strx_buf_init(strx_buf_t *b, char *buf, size_t size) {
+  b->base = b->cur = buf;
+  b->end = buf + size;
+  b->truncated = 0;
+  *buf = '\0';
+}
+
+char *strx_buf_puts(strx_buf_t *b, const char *s) {
+  char *start = b->cur;
+  b->cur = strxcpy(b->cur, b->end, s, SIZE_MAX);
+  if (s[b->cur - start] != '\0')
+    b->truncated = 1;
+  return b->cur;
+}
+
+char *strx_buf_putn(strx_buf_t *b, const char *s, size_t n) {
+  size_t avail = b->end - b->cur - 1;
+  if (n > avail) {
+    n = avail;
+    b->truncated = 1;
+  }
+  memcpy(b->cur, s, n);
+  b->cur += n;
+  *b->cur = '\0';
+  return b->cur;
+}
+
+char *strx_buf_putv(strx_buf_t *b, const strx_iovec_t *iov, size_t iovcnt) {
+  size_t fit;
+  b->cur = strxcpyv(b->cur, b->end, iov, iovcnt, &fit);
+  if (fit < iovcnt)
+    b->truncated = 1;
+  return b->cur;
+}
+
+char *strx_buf_putull(strx_buf_t *b, unsigned long long int x,
+                      int base, const char *digits) {
+  char buf[sizeof(unsigned long long) * 8 / 3 + 2];
+  char *p = strxfromull(buf, buf + sizeof(buf), x, base, digits);
+  return strx_buf_putn(b, buf, p - buf);
+}
+
+char *strx_buf_putll(strx_buf_t *b, long long int x) {
+  char buf[sizeof(long long) * 8 / 3 + 3];
+  char *p = buf;
+  if (x < 0)
+    *p++ = '-';
+  unsigned long long int ux =
+    (x < 0)? -(unsigned long long int) x : (unsigned long long int) x;
+  p = strxfromull(p, buf + sizeof(buf), ux, 10, "0123456789");
+  return strx_buf_putn(b, buf, p - buf);
+}
+
+char *strx_buf_putd(strx_buf_t *b, double x, int prec) {
+  b->cur = strxfromd(b->cur, b->end, x, prec);
+  if (b->cur == b->end - 1)
+    b->truncated = 1;
+  return b->cur;
+}
+
+char *strx_buf_vprintf(strx_buf_t *b, const char *fmt, va_list ap) {
+  b->cur = vsxprintf(b->cur, b->end, fmt, ap);
+  if (b->cur == b->end - 1)
+    b->truncated = 1;
+  return b->cur;
+}
+
+char *strx_buf_printf(strx_buf_t *b, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  char *res = strx_buf_vprintf(b, fmt, ap);
+  va_end(ap);
+  return res;
+}
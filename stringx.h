@@ -32,7 +32,12 @@
 #define __STRINGX_H__
 
 #include <stdarg.h>     /* va_list */
-#include <stddef.h>     /* size_t */
+#include <stddef.h>     /* size_t, wchar_t */
+#include <stdint.h>     /* uint16_t, uint32_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #if !__GNUC__ && !defined(__attribute__)
 #define __attribute__(x)
@@ -51,6 +56,29 @@ extern char *strxcpy(
     char *dest, const char *dest_end,
     const char *src, size_t n);
 
+/* A piece of string to be copied by strxcpyv().  If len is STRX_NTS,
+ * base is a NUL terminated string and is scanned for its length;
+ * otherwise exactly len bytes are copied verbatim, and they must not
+ * contain a NUL.
+ */
+typedef struct strx_iovec_s {
+  const char *base;
+  size_t len;
+} strx_iovec_t;
+
+#define STRX_NTS ((size_t) -1)
+
+/* Copies/appends iovcnt pieces of string from iov to the string
+ * buffer, one after another, until all pieces are copied or the
+ * string buffer is full.  If fit_p is not NULL, the number of pieces
+ * that were copied in full is stored there; a piece that was cut
+ * short is not counted.  This is equivalent to, but much faster than,
+ * calling strxcpy() once for each piece.
+ */
+extern char *strxcpyv(
+    char *dest, const char *dest_end,
+    const strx_iovec_t *iov, size_t iovcnt, size_t *fit_p);
+
 /* Converts an unsigned long long to a string buffer, using a given
  * base and a given string of digits to use.
  */
@@ -58,6 +86,14 @@ extern char *strxfromull(
     char *dest, const char *dest_end,
     unsigned long long int x, int base, const char *digits);
 
+/* Converts a double to a string buffer in fixed point notation with
+ * prec digits after the decimal point, like "%.*f" would, rounding the
+ * exact binary value to nearest, ties to even.  Large magnitudes and
+ * precisions take a slower exact path, still without the C library.
+ */
+extern char *strxfromd(
+    char *dest, const char *dest_end, double x, int prec);
+
 /* Formats a string into the string buffer, truncated to the capacity
  * of the buffer.  The vsxprintf() variant takes an argument pointer,
  * and the sxprintf variant is a variadic function that takes any
@@ -91,6 +127,159 @@ extern char *snxprintf(
     __printf_format_string const char *fmt, ...)
   __attribute__(( format(printf, 3, 4) ));
 
-/* TODO(liulk): make wcs* variants available too. */
+/* A string buffer builder tracks the beginning of the string buffer
+ * (base), the zero terminator (cur) and the end of the buffer (end),
+ * so that the length of the string is known without measuring it.
+ * The truncated flag is sticky: it is set once any append did not fit
+ * in full, so the caller can check only once after building the
+ * string, and retry with a larger buffer if so desired.
+ *
+ *   char buf[80];
+ *   strx_buf_t b;
+ *   strx_buf_init(&b, buf, sizeof(buf));
+ *   strx_buf_puts(&b, "pid ");
+ *   strx_buf_putll(&b, getpid());
+ *   if (strx_buf_truncated(&b))
+ *     ...
+ *
+ * The append functions return the new zero terminator, like the rest
+ * of the string buffer functions.  Formatted appends (putd, printf)
+ * cannot tell an exact fit from truncation, so filling the buffer to
+ * capacity is reported as truncation.
+ */
+typedef struct strx_buf_s {
+  char *base;
+  char *cur;
+  const char *end;
+  int truncated;
+} strx_buf_t;
+
+#define strx_buf_len(b)         ((size_t) ((b)->cur - (b)->base))
+#define strx_buf_truncated(b)   ((b)->truncated)
+
+extern void strx_buf_init(strx_buf_t *b, char *buf, size_t size);
+
+/* Appends a zero terminated string. */
+extern char *strx_buf_puts(strx_buf_t *b, const char *s);
+
+/* Appends exactly n bytes, which should not contain a zero. */
+extern char *strx_buf_putn(strx_buf_t *b, const char *s, size_t n);
+
+/* Appends pieces of string, see strxcpyv(). */
+extern char *strx_buf_putv(
+    strx_buf_t *b, const strx_iovec_t *iov, size_t iovcnt);
+
+/* Appends integers, see strxfromull(); putll() is signed decimal. */
+extern char *strx_buf_putull(
+    strx_buf_t *b, unsigned long long int x, int base, const char *digits);
+extern char *strx_buf_putll(strx_buf_t *b, long long int x);
+
+/* Appends a double, see strxfromd(). */
+extern char *strx_buf_putd(strx_buf_t *b, double x, int prec);
+
+/* Appends formatted text, see vsxprintf() and sxprintf(). */
+extern char *strx_buf_vprintf(
+    strx_buf_t *b, __printf_format_string const char *fmt, va_list ap)
+  __attribute__(( format(printf, 2, 0) ));
+
+extern char *strx_buf_printf(
+    strx_buf_t *b, __printf_format_string const char *fmt, ...)
+  __attribute__(( format(printf, 2, 3) ));
+
+/* Renders n bytes of binary data at src into the string buffer as
+ * lowercase hex digits (strxhex), as a hex dump with offsets and ASCII
+ * columns, 16 bytes per line and lines separated by newlines
+ * (strxhexdump), or as padded base64 (strxbase64).  Output is only
+ * ever truncated at a byte, line or base64 quantum boundary.
+ */
+extern char *strxhex(
+    char *dest, const char *dest_end, const void *src, size_t n);
+
+extern char *strxhexdump(
+    char *dest, const char *dest_end, const void *src, size_t n);
+
+extern char *strxbase64(
+    char *dest, const char *dest_end, const void *src, size_t n);
+
+/* The same, but returning buf, for use as an argument to %s.  In C,
+ * the STRX_HEX(), STRX_HEXDUMP() and STRX_BASE64() macros supply a
+ * temporary buffer of STRX_BIN_STRSIZE bytes that lives until the end
+ * of the enclosing block:
+ *
+ *   INFO("key = %s", STRX_HEX(key, key_len));
+ *
+ * The macros use compound literals, which C++ does not have; there,
+ * pass a buffer of your own.  Nor are they lazy: the buffer is zero
+ * filled and the data converted where the macro is evaluated, even if
+ * the record is then dropped for its level, so keep them off hot
+ * paths or behind LOG_IF().  A new printf conversion would not survive
+ * -Wformat, hence %s.
+ */
+extern const char *strx_hexstr(
+    char *buf, size_t size, const void *src, size_t n);
+
+extern const char *strx_hexdumpstr(
+    char *buf, size_t size, const void *src, size_t n);
+
+extern const char *strx_base64str(
+    char *buf, size_t size, const void *src, size_t n);
+
+#define STRX_BIN_STRSIZE        1024
+
+#ifndef __cplusplus
+#define STRX_HEX(src, n) \
+  strx_hexstr((char[STRX_BIN_STRSIZE]) { 0 }, STRX_BIN_STRSIZE, src, n)
+#define STRX_HEXDUMP(src, n) \
+  strx_hexdumpstr((char[STRX_BIN_STRSIZE]) { 0 }, STRX_BIN_STRSIZE, src, n)
+#define STRX_BASE64(src, n) \
+  strx_base64str((char[STRX_BIN_STRSIZE]) { 0 }, STRX_BIN_STRSIZE, src, n)
+#endif  /* __cplusplus */
+
+/* Wide character variants of the functions above, with the same
+ * semantics except that the units are wchar_t instead of char.  For
+ * vswxprintf() and swxprintf(), %s takes a UTF-8 string and %ls takes
+ * a wide string.
+ */
+extern wchar_t *wcsxcpy(
+    wchar_t *dest, const wchar_t *dest_end,
+    const wchar_t *src, size_t n);
+
+extern wchar_t *wcsxfromull(
+    wchar_t *dest, const wchar_t *dest_end,
+    unsigned long long int x, int base, const wchar_t *digits);
+
+extern wchar_t *vswxprintf(
+    wchar_t *dest, const wchar_t *dest_end,
+    const wchar_t *fmt, va_list ap);
+
+extern wchar_t *swxprintf(
+    wchar_t *dest, const wchar_t *dest_end,
+    const wchar_t *fmt, ...);
+
+/* Returns the number of code units of a UTF-16 or UTF-32 string before
+ * the zero terminator, but at most maxlen.  Uses SIMD where available.
+ */
+extern size_t strx_u16len(const uint16_t *s, size_t maxlen);
+extern size_t strx_u32len(const uint32_t *s, size_t maxlen);
+
+/* Transcodes at most n code units of a UTF-16, UTF-32 or wide string
+ * to UTF-8 and copies/appends it to the string buffer.  A multibyte
+ * sequence that does not fit is left out in its entirety, so the
+ * string buffer always holds valid UTF-8.  Unpaired surrogates and
+ * invalid code points become U+FFFD.  char16_t and char32_t strings
+ * can be passed as uint16_t and uint32_t respectively.
+ */
+extern char *strxfromu16(
+    char *dest, const char *dest_end, const uint16_t *src, size_t n);
+
+extern char *strxfromu32(
+    char *dest, const char *dest_end, const uint32_t *src, size_t n);
+
+extern char *strxfromwcs(
+    char *dest, const char *dest_end, const wchar_t *src, size_t n);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
 
 #endif  /* __STRINGX_H__ */
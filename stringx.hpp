@@ -0,0 +1,251 @@
+/* String buffer operations, C++ interface.
+ * Copyright (C) 2009--2013  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Type safe sxprintf() for C++17 and later.  The format string is
+ * parsed at compile time into a sequence of append operations on a
+ * string buffer builder, and the types of the arguments are checked
+ * against the conversions.  There is no va_list involved, and the
+ * resulting code is a straight sequence of strx_buf_put*() calls.
+ *
+ *   char buf[80];
+ *   strx::sxprintf(buf, buf + sizeof(buf), STRX_FMT("%s = %d"), "x", x);
+ *
+ * The format string must be a string literal wrapped in STRX_FMT().
+ * Supported conversions are %d %i %u %o %x %X %c %s %p %f %F and %%.
+ * Flags, field width and length modifiers are accepted and ignored,
+ * like vsxprintf() does; the precision is honored by %f.  Unlike
+ * vsxprintf(), %s also accepts std::string and std::string_view.
+ */
+
+#ifndef __STRINGX_HPP__
+#define __STRINGX_HPP__
+
+#include <cstddef>      /* std::size_t */
+#include <cstdint>      /* std::uintptr_t */
+#include <string_view>  /* std::string_view */
+#include <tuple>        /* std::forward_as_tuple(), std::get() */
+#include <type_traits>  /* std::is_integral_v, std::make_unsigned_t */
+#include <utility>      /* std::index_sequence */
+
+#include "stringx.h"
+
+/* Wraps a string literal into a type that carries it, so the literal
+ * can be parsed at compile time.
+ */
+#define STRX_FMT(s)                                                     \
+  ([] {                                                                 \
+    struct strx_fmt_t {                                                 \
+      static constexpr std::string_view value() { return s; }           \
+    };                                                                  \
+    return strx_fmt_t{};                                                \
+  }())
+
+namespace strx {
+
+namespace detail {
+
+enum class kind {
+  literal, dec, udec, oct, hex, upper_hex, chr, str, ptr, fixed,
+};
+
+struct spec {
+  kind k;
+  std::size_t pos;      /* literal: offset into the format string */
+  std::size_t len;      /* literal: length */
+  int prec;             /* fixed: digits after the decimal point */
+  std::size_t arg;      /* conversion: argument index */
+};
+
+/* A format string of n characters has at most n + 1 specs. */
+template <std::size_t N>
+struct spec_list {
+  spec items[N] = {};
+  std::size_t size = 0;
+  std::size_t nargs = 0;
+};
+
+constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+template <std::size_t N>
+constexpr spec_list<N> parse(std::string_view fmt) {
+  spec_list<N> res;
+  std::size_t i = 0;
+
+  while (i < fmt.size()) {
+    std::size_t j = i;
+    while (j < fmt.size() && fmt[j] != '%')
+      j++;
+    if (j > i)
+      res.items[res.size++] = spec{kind::literal, i, j - i, 0, 0};
+    if (j == fmt.size())
+      break;
+
+    /* begin format specification */
+
+    i = j + 1;
+    if (i == fmt.size())
+      throw "stringx: format ends in the middle of a conversion";
+
+    if (fmt[i] == '%') {
+      res.items[res.size++] = spec{kind::literal, i, 1, 0, 0};
+      i++;
+      continue;
+    }
+
+    while (i < fmt.size() &&
+           (fmt[i] == '#' || fmt[i] == '0' || fmt[i] == '-' ||
+            fmt[i] == ' ' || fmt[i] == '+' || fmt[i] == '\''))
+      i++;
+    while (i < fmt.size() && is_digit(fmt[i]))
+      i++;
+
+    int prec = -1;
+    if (i < fmt.size() && fmt[i] == '.') {
+      prec = 0;
+      for (i++; i < fmt.size() && is_digit(fmt[i]); i++)
+        prec = prec * 10 + (fmt[i] - '0');
+    }
+
+    while (i < fmt.size() &&
+           (fmt[i] == 'h' || fmt[i] == 'l' || fmt[i] == 'j' ||
+            fmt[i] == 'z' || fmt[i] == 't'))
+      i++;
+
+    if (i == fmt.size())
+      throw "stringx: format ends in the middle of a conversion";
+
+    kind k = kind::literal;
+    switch (fmt[i]) {
+    case 'd': case 'i': k = kind::dec; break;
+    case 'u': k = kind::udec; break;
+    case 'o': k = kind::oct; break;
+    case 'x': k = kind::hex; break;
+    case 'X': k = kind::upper_hex; break;
+    case 'c': k = kind::chr; break;
+    case 's': k = kind::str; break;
+    case 'p': k = kind::ptr; break;
+    case 'f': case 'F': k = kind::fixed; break;
+    default:
+      throw "stringx: unsupported conversion in format";
+    }
+    i++;
+
+    res.items[res.size++] = spec{k, 0, 0, (prec < 0)? 6 : prec, res.nargs++};
+  }
+
+  return res;
+}
+
+template <class Fmt>
+inline constexpr auto parsed =
+  parse<Fmt::value().size() + 1>(Fmt::value());
+
+template <class T>
+using bare_t = std::remove_cv_t<std::remove_reference_t<T>>;
+
+template <class T>
+inline constexpr bool is_c_string_v =
+  std::is_same_v<std::decay_t<T>, const char *> ||
+  std::is_same_v<std::decay_t<T>, char *>;
+
+template <kind K, int Prec, class T>
+inline void append_arg(strx_buf_t *b, const T &x) {
+  using U = bare_t<T>;
+
+  if constexpr (K == kind::dec) {
+    static_assert(std::is_integral_v<U>, "%d/%i needs an integer");
+    if constexpr (std::is_signed_v<U>)
+      strx_buf_putll(b, x);
+    else
+      strx_buf_putull(b, x, 10, "0123456789");
+  } else if constexpr (K == kind::udec || K == kind::oct || K == kind::hex ||
+                       K == kind::upper_hex) {
+    static_assert(std::is_integral_v<U>, "%u/%o/%x/%X needs an integer");
+    strx_buf_putull(b, static_cast<std::make_unsigned_t<U>>(x),
+                    (K == kind::udec)? 10 : (K == kind::oct)? 8 : 16,
+                    (K == kind::upper_hex)? "0123456789ABCDEF"
+                                          : "0123456789abcdef");
+  } else if constexpr (K == kind::chr) {
+    static_assert(std::is_integral_v<U>, "%c needs a character");
+    char c = static_cast<char>(x);
+    strx_buf_putn(b, &c, 1);
+  } else if constexpr (K == kind::str) {
+    static_assert(is_c_string_v<U> ||
+                  std::is_convertible_v<const U &, std::string_view>,
+                  "%s needs a string");
+    if constexpr (std::is_array_v<U>)
+      strx_buf_puts(b, x);
+    else if constexpr (is_c_string_v<U>)
+      strx_buf_puts(b, x? x : "(null)");
+    else {
+      std::string_view sv = x;
+      strx_buf_putn(b, sv.data(), sv.size());
+    }
+  } else if constexpr (K == kind::ptr) {
+    static_assert(std::is_pointer_v<std::decay_t<U>>, "%p needs a pointer");
+    strx_buf_putn(b, "0x", 2);
+    strx_buf_putull(b, reinterpret_cast<std::uintptr_t>(x),
+                    16, "0123456789abcdef");
+  } else if constexpr (K == kind::fixed) {
+    static_assert(std::is_floating_point_v<U>, "%f needs a floating point");
+    strx_buf_putd(b, static_cast<double>(x), Prec);
+  }
+}
+
+template <class Fmt, std::size_t I, class Tuple>
+inline void append_one(strx_buf_t *b, const Tuple &args) {
+  constexpr spec s = parsed<Fmt>.items[I];
+  if constexpr (s.k == kind::literal)
+    strx_buf_putn(b, Fmt::value().data() + s.pos, s.len);
+  else
+    append_arg<s.k, s.prec>(b, std::get<s.arg>(args));
+}
+
+template <class Fmt, class Tuple, std::size_t... Is>
+inline void append_all(strx_buf_t *b, const Tuple &args,
+                       std::index_sequence<Is...>) {
+  (append_one<Fmt, Is>(b, args), ...);
+}
+
+}  /* namespace detail */
+
+/* Appends formatted text to a string buffer builder, see
+ * strx_buf_printf().
+ */
+template <class Fmt, class... Args>
+inline char *buf_printf(strx_buf_t *b, Fmt, const Args &... args) {
+  constexpr auto &specs = detail::parsed<Fmt>;
+  static_assert(specs.nargs == sizeof...(Args),
+                "number of arguments does not match the format");
+  if constexpr (specs.nargs == sizeof...(Args))
+    detail::append_all<Fmt>(b, std::forward_as_tuple(args...),
+                            std::make_index_sequence<specs.size>{});
+  return b->cur;
+}
+
+/* Formats a string into the string buffer, see sxprintf(). */
+template <class Fmt, class... Args>
+inline char *sxprintf(char *dest, const char *dest_end,
+                      Fmt fmt, const Args &... args) {
+  strx_buf_t b;
+  strx_buf_init(&b, dest, dest_end - dest);
+  return buf_printf(&b, fmt, args...);
+}
+
+}  /* namespace strx */
+
+#endif  /* __STRINGX_HPP__ */
@@ -0,0 +1,189 @@
+/* Binary to text string buffer operations.
+ * Copyright (C) 2009--2013  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>     /* size_t */
+#include <string.h>     /* memset() */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>  /* _mm_unpacklo_epi8(), _mm_cmpgt_epi8() */
+#endif
+
+#include "stringx.h"
+
+static const char k_hex_digits[] = "0123456789abcdef";
+
+/* Writes 2 * n hex digits for n bytes, without a terminator. */
+static void hex_encode(char *out, const unsigned char *in, size_t n) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  /* Splits 16 bytes into 32 nibbles in output order, then maps each
+   * nibble to '0'..'9' or 'a'..'f' by adding '0', plus the distance to
+   * 'a' for nibbles greater than 9.
+   */
+  const __m128i low_mask = _mm_set1_epi8(0x0f);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i ascii_zero = _mm_set1_epi8('0');
+  const __m128i alpha_delta = _mm_set1_epi8('a' - '0' - 10);
+
+  for ( ; n - i >= 16; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_mask);
+    __m128i lo = _mm_and_si128(v, low_mask);
+
+    __m128i a = _mm_unpacklo_epi8(hi, lo);
+    __m128i b = _mm_unpackhi_epi8(hi, lo);
+
+    a = _mm_add_epi8(_mm_add_epi8(a, ascii_zero),
+                     _mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha_delta));
+    b = _mm_add_epi8(_mm_add_epi8(b, ascii_zero),
+                     _mm_and_si128(_mm_cmpgt_epi8(b, nine), alpha_delta));
+
+    _mm_storeu_si128((__m128i *) (out + 2 * i), a);
+    _mm_storeu_si128((__m128i *) (out + 2 * i + 16), b);
+  }
+#endif
+
+  for ( ; i < n; i++) {
+    out[2 * i] = k_hex_digits[in[i] >> 4];
+    out[2 * i + 1] = k_hex_digits[in[i] & 0x0f];
+  }
+}
+
+char *strxhex(char *dest, const char *dest_end, const void *src, size_t n) {
+  size_t avail = (dest_end - dest - 1) / 2;
+  if (n > avail)
+    n = avail;  /* whole bytes only */
+
+  hex_encode(dest, (const unsigned char *) src, n);
+  dest += 2 * n;
+  *dest = '\0';
+
+  return dest;
+}
+
+/* One line of strxhexdump() looks like this, 78 characters long:
+ *
+ * 00000000  48 65 6c 6c 6f 2c 20 77  6f 72 6c 64 21 0a 00 01  |Hello, world!...|
+ */
+
+#define HEXDUMP_LINE_BYTES      16
+#define HEXDUMP_LINE_SIZE       78
+
+char *strxhexdump(char *dest, const char *dest_end,
+                  const void *src, size_t n) {
+  const unsigned char *p = (const unsigned char *) src;
+  size_t offset;
+
+  for (offset = 0; offset < n; offset += HEXDUMP_LINE_BYTES) {
+    size_t count = n - offset;
+    if (count > HEXDUMP_LINE_BYTES)
+      count = HEXDUMP_LINE_BYTES;
+
+    /* The ASCII column of the last line is only as wide as its bytes. */
+    size_t line_size = HEXDUMP_LINE_SIZE - (HEXDUMP_LINE_BYTES - count) +
+                       (offset > 0);  /* '\n' */
+    if ((size_t) (dest_end - dest - 1) < line_size)
+      break;  /* whole lines only */
+
+    if (offset > 0)
+      *dest++ = '\n';
+
+    char hex[2 * HEXDUMP_LINE_BYTES];
+    hex_encode(hex, p + offset, count);
+
+    char *line = dest;
+    char *ascii = line + 10 + 3 * HEXDUMP_LINE_BYTES + 2;
+    memset(line, ' ', ascii - line);
+
+    unsigned int x = (unsigned int) offset;
+    int k;
+    for (k = 7; k >= 0; k--, x >>= 4)
+      line[k] = k_hex_digits[x & 0x0f];
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+      char *col = line + 10 + 3 * i + (i >= 8);
+      col[0] = hex[2 * i];
+      col[1] = hex[2 * i + 1];
+    }
+
+    ascii[0] = '|';
+    for (i = 0; i < count; i++) {
+      unsigned char c = p[offset + i];
+      ascii[1 + i] = (c >= 0x20 && c < 0x7f)? c : '.';
+    }
+    ascii[1 + count] = '|';
+
+    dest = ascii + 2 + count;
+  }
+  *dest = '\0';
+
+  return dest;
+}
+
+static const char k_base64_digits[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+char *strxbase64(char *dest, const char *dest_end,
+                 const void *src, size_t n) {
+  const unsigned char *p = (const unsigned char *) src;
+  size_t quanta = (dest_end - dest - 1) / 4;
+  if (n > quanta * 3)
+    n = quanta * 3;  /* whole quanta only */
+
+  size_t i;
+  for (i = 0; i + 3 <= n; i += 3) {
+    unsigned int x = (p[i] << 16) | (p[i + 1] << 8) | p[i + 2];
+    dest[0] = k_base64_digits[x >> 18];
+    dest[1] = k_base64_digits[(x >> 12) & 0x3f];
+    dest[2] = k_base64_digits[(x >> 6) & 0x3f];
+    dest[3] = k_base64_digits[x & 0x3f];
+    dest += 4;
+  }
+
+  if (i < n) {  /* one or two bytes left, padded */
+    unsigned int x = p[i] << 16;
+    if (i + 1 < n)
+      x |= p[i + 1] << 8;
+    dest[0] = k_base64_digits[x >> 18];
+    dest[1] = k_base64_digits[(x >> 12) & 0x3f];
+    dest[2] = (i + 1 < n)? k_base64_digits[(x >> 6) & 0x3f] : '=';
+    dest[3] = '=';
+    dest += 4;
+  }
+  *dest = '\0';
+
+  return dest;
+}
+
+const char *strx_hexstr(char *buf, size_t size, const void *src, size_t n) {
+  strxhex(buf, buf + size, src, n);
+  return buf;
+}
+
+const char *strx_hexdumpstr(char *buf, size_t size,
+                            const void *src, size_t n) {
+  strxhexdump(buf, buf + size, src, n);
+  return buf;
+}
+
+const char *strx_base64str(char *buf, size_t size,
+                           const void *src, size_t n) {
+  strxbase64(buf, buf + size, src, n);
+  return buf;
+}
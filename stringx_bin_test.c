@@ -0,0 +1,127 @@
+#include "stringx.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Renders src at every buffer size up to one byte past the whole
+ * output, which must always be the longest prefix of expected that
+ * ends on a multiple of unit bytes, or on a line for a unit of 0.
+ */
+static int check_truncation(const char *label,
+                            char *(*render)(char *, const char *,
+                                            const void *, size_t),
+                            const void *src, size_t n, const char *expected,
+                            size_t unit)
+{
+  size_t expected_len = strlen(expected), size;
+  char buf[1024];
+  int failures = 0;
+
+  for (size = 1; size <= expected_len + 2; size++) {
+    size_t fit = size - 1;
+    if (fit >= expected_len)
+      fit = expected_len;
+    else if (unit)
+      fit -= fit % unit;
+    else {
+      while (fit > 0 && expected[fit] != '\n')
+        fit--;
+    }
+
+    memset(buf, 0x7f, sizeof(buf));
+    char *end = render(buf, buf + size, src, n);
+    int ok = end == buf + fit && *end == '\0' &&
+      memcmp(buf, expected, fit) == 0;
+    if (!ok)
+      printf("%s: size %zu: got \"%s\", expected %zu bytes\n",
+             label, size, buf, fit);
+    failures += !ok;
+  }
+
+  printf("%s %zu: %s\n", label, n, failures? "FAILED" : "ok");
+  return failures;
+}
+
+/* Reference renderings, one byte at a time. */
+
+static void hex(char *out, const unsigned char *src, size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; i++)
+    out += sprintf(out, "%02x", src[i]);
+}
+
+static void hexdump(char *out, const unsigned char *src, size_t n)
+{
+  size_t offset, i;
+  for (offset = 0; offset < n; offset += 16) {
+    size_t count = (n - offset < 16)? n - offset : 16;
+    if (offset > 0)
+      *out++ = '\n';
+    out += sprintf(out, "%08zx  ", offset);
+    for (i = 0; i < 16; i++) {
+      if (i < count)
+        out += sprintf(out, "%02x ", src[offset + i]);
+      else
+        out += sprintf(out, "   ");
+      if (i == 7)
+        *out++ = ' ';
+    }
+    *out++ = ' ';
+    *out++ = '|';
+    for (i = 0; i < count; i++) {
+      unsigned char c = src[offset + i];
+      *out++ = (c >= 0x20 && c < 0x7f)? c : '.';
+    }
+    *out++ = '|';
+  }
+  *out = '\0';
+}
+
+int main()
+{
+  int failures = 0;
+  unsigned char data[256];
+  char expected[8192];
+  size_t i, n;
+
+  for (i = 0; i < sizeof(data); i++)
+    data[i] = i * 7 + 3;
+
+  /* Sizes around the 16 byte vector loop. */
+  for (n = 0; n <= 40; n++) {
+    hex(expected, data, n);
+    failures += check_truncation("strxhex", strxhex, data, n, expected, 2);
+  }
+
+  /* Empty, partial, single and multiple lines. */
+  size_t dump_sizes[] = { 0, 1, 8, 9, 16, 17, 40, 48 };
+  for (i = 0; i < sizeof(dump_sizes) / sizeof(dump_sizes[0]); i++) {
+    n = dump_sizes[i];
+    hexdump(expected, data, n);
+    failures += check_truncation("strxhexdump", strxhexdump, data, n,
+                                 expected, 0);
+  }
+
+  /* The test vectors of RFC 4648. */
+  const char *base64[] = {
+    "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy",
+  };
+  for (n = 0; n < sizeof(base64) / sizeof(base64[0]); n++)
+    failures += check_truncation("strxbase64", strxbase64, "foobar", n,
+                                 base64[n], 4);
+
+  /* The temporary buffers of the macros. */
+  int res = strcmp(STRX_HEX("\x01\xab", 2), "01ab") != 0 ||
+    strcmp(STRX_BASE64("foo", 3), "Zm9v") != 0 ||
+    strncmp(STRX_HEXDUMP("AB", 2), "00000000  41 42", 15) != 0;
+  hex(expected, data, sizeof(data));
+  res |= strlen(STRX_HEX(data, sizeof(data))) != 2 * sizeof(data);
+  const char *truncated = STRX_HEX(expected, sizeof(expected));
+  res |= strlen(truncated) != STRX_BIN_STRSIZE - 2;
+  printf("macros: %s\n", res? "FAILED" : "ok");
+  failures += res;
+
+  printf("%s\n", failures? "FAIL" : "PASS");
+  return failures != 0;
+}
@@ -0,0 +1,124 @@
+#include "stringx.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Compares strxfromd() with the C library, at the full size and at
+ * every smaller one, where the output must be a prefix.
+ */
+static int check_fromd(double x, int prec)
+{
+  static char expected[2048], got[2048];
+  snprintf(expected, sizeof(expected), "%.*f", prec, x);
+  size_t len = strlen(expected), size;
+
+  char *end = strxfromd(got, got + sizeof(got), x, prec);
+  int failed = end != got + len || strcmp(got, expected) != 0;
+  if (failed)
+    printf("strxfromd(%a, %d) = %s, expected %s\n", x, prec, got, expected);
+
+  for (size = 1; size <= len && !failed; size++) {
+    end = strxfromd(got, got + size, x, prec);
+    failed = end != got + size - 1 || memcmp(got, expected, size - 1) != 0 ||
+      *end != '\0';
+    if (failed)
+      printf("strxfromd(%a, %d) at size %zu = %s\n", x, prec, size, got);
+  }
+  return failed;
+}
+
+static double random_double()
+{
+  unsigned long long bits = 0;
+  int i;
+  for (i = 0; i < 4; i++)
+    bits = (bits << 16) ^ (rand() & 0xffff);
+  double x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+int main()
+{
+  int failures = 0, prec, i;
+
+  /* Ties, which round to even on the exact binary value, and values
+   * just below them.
+   */
+  static const double ties[] = {
+    0.5, 1.5, 2.5, 0.125, 0.375, 2.675, 1.005, 0.045, 1e-7, 5e-10,
+    999999999.9999999, 0.0, -0.0, -2.5,
+  };
+  for (i = 0; i < (int) (sizeof(ties) / sizeof(ties[0])); i++)
+    for (prec = 0; prec <= 12; prec++)
+      failures += check_fromd(ties[i], prec);
+
+  /* Magnitudes and precisions past the fixed point fast path. */
+  static const double big[] = {
+    1e18, 123456789012345678901234.0, 9007199254740993.0, 1e300, DBL_MAX,
+    DBL_MIN, 4.9406564584124654e-324, 1.0 / 3.0,
+  };
+  static const int big_precs[] = { 0, 9, 10, 17, 30, 400, 1074, 1100 };
+  int k;
+  for (i = 0; i < (int) (sizeof(big) / sizeof(big[0])); i++)
+    for (k = 0; k < (int) (sizeof(big_precs) / sizeof(big_precs[0])); k++)
+      failures += check_fromd(big[i], big_precs[k]);
+
+  /* Random bit patterns, rounded at every precision up to 20. */
+  srand(1);
+  for (i = 0; i < 2000; i++) {
+    double x = random_double();
+    if (isnan(x) || fabs(x) > 1e40)
+      continue;
+    failures += check_fromd(x, i % 21);
+  }
+  printf("strxfromd: %s\n", failures? "FAILED" : "ok");
+
+  /* String buffer builders: the truncated flag is sticky. */
+  char buf[8];
+  strx_buf_t b;
+  int res = 0;
+
+  strx_buf_init(&b, buf, sizeof(buf));
+  strx_buf_putn(&b, "abc", 3);
+  strx_buf_puts(&b, "dddd");
+  res |= strx_buf_truncated(&b) || strcmp(buf, "abcdddd") != 0;
+  strx_buf_puts(&b, "e");
+  res |= !strx_buf_truncated(&b) || strx_buf_len(&b) != 7;
+  strx_buf_putn(&b, "", 0);
+  strx_buf_puts(&b, "");
+  res |= !strx_buf_truncated(&b) || strcmp(buf, "abcdddd") != 0;
+
+  /* Each kind of append sets it. */
+  strx_buf_init(&b, buf, sizeof(buf));
+  strx_buf_putull(&b, 123456789, 10, "0123456789");
+  res |= !strx_buf_truncated(&b) || strcmp(buf, "1234567") != 0;
+  strx_buf_init(&b, buf, sizeof(buf));
+  strx_buf_putll(&b, -1234567);
+  res |= !strx_buf_truncated(&b) || strcmp(buf, "-123456") != 0;
+  strx_buf_init(&b, buf, sizeof(buf));
+  strx_buf_putd(&b, 3.14159265, 6);
+  res |= !strx_buf_truncated(&b) || strcmp(buf, "3.14159") != 0;
+  strx_buf_init(&b, buf, sizeof(buf));
+  strx_buf_printf(&b, "%d-%s", 42, "abcdef");
+  res |= !strx_buf_truncated(&b) || strcmp(buf, "42-abcd") != 0;
+  strx_iovec_t iov[2] = { { "abcd", STRX_NTS }, { "efgh", 4 } };
+  strx_buf_init(&b, buf, sizeof(buf));
+  strx_buf_putv(&b, iov, 2);
+  res |= !strx_buf_truncated(&b) || strcmp(buf, "abcdefg") != 0;
+
+  /* And what fits does not. */
+  strx_buf_init(&b, buf, sizeof(buf));
+  strx_buf_putll(&b, -12);
+  strx_buf_putd(&b, 0.5, 1);
+  res |= strx_buf_truncated(&b) || strcmp(buf, "-120.5") != 0;
+
+  printf("strx_buf: %s\n", res? "FAILED" : "ok");
+  failures += res;
+
+  printf("%s\n", failures? "FAIL" : "PASS");
+  return failures != 0;
+}
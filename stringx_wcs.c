@@ -0,0 +1,500 @@
+/* Wide character string buffer operations.
+ * Copyright (C) 2009--2013  Likai Liu <liulk@cs.bu.edu>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>     /* assert() */
+#include <stdarg.h>     /* va_list, va_start(), va_end() */
+#include <stddef.h>     /* ptrdiff_t */
+#include <stdint.h>     /* intmax_t, uint16_t, uint32_t, uintptr_t, SIZE_MAX */
+#include <stdlib.h>     /* abort() */
+#include <string.h>     /* memcpy() */
+#include <wchar.h>      /* wchar_t, wint_t, WCHAR_MAX */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>  /* _mm_cmpeq_epi16(), _mm_movemask_epi8() */
+#endif
+
+#include "stringx.h"
+
+/**********************************************************************/
+/* Length of 2- and 4-byte code unit strings                          */
+/**********************************************************************/
+
+/* The SSE2 kernels scan one code unit at a time until the pointer is
+ * 16-byte aligned, then compare 16 bytes at a time.  An aligned load
+ * never crosses a page boundary, so reading past the terminator or
+ * past maxlen within the same 16 bytes is safe.
+ */
+
+size_t strx_u16len(const uint16_t *s, size_t maxlen) {
+  const uint16_t *p = s;
+
+#if defined(__SSE2__)
+  if (((uintptr_t) s & 1) == 0) {
+    for ( ; ((uintptr_t) p & 15) != 0; p++)
+      if ((size_t) (p - s) >= maxlen || *p == 0)
+        return p - s;
+
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; (size_t) (p - s) < maxlen; p += 8) {
+      __m128i v = _mm_load_si128((const __m128i *) p);
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v, zero));
+      if (mask) {
+        size_t len = (p - s) + (__builtin_ctz(mask) >> 1);
+        return (len < maxlen)? len : maxlen;
+      }
+    }
+    return maxlen;
+  }
+#endif
+
+  for ( ; (size_t) (p - s) < maxlen && *p != 0; p++)
+    ;
+  return p - s;
+}
+
+size_t strx_u32len(const uint32_t *s, size_t maxlen) {
+  const uint32_t *p = s;
+
+#if defined(__SSE2__)
+  if (((uintptr_t) s & 3) == 0) {
+    for ( ; ((uintptr_t) p & 15) != 0; p++)
+      if ((size_t) (p - s) >= maxlen || *p == 0)
+        return p - s;
+
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; (size_t) (p - s) < maxlen; p += 4) {
+      __m128i v = _mm_load_si128((const __m128i *) p);
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(v, zero));
+      if (mask) {
+        size_t len = (p - s) + (__builtin_ctz(mask) >> 2);
+        return (len < maxlen)? len : maxlen;
+      }
+    }
+    return maxlen;
+  }
+#endif
+
+  for ( ; (size_t) (p - s) < maxlen && *p != 0; p++)
+    ;
+  return p - s;
+}
+
+#if WCHAR_MAX > 0xffff
+#  define wcsxlen(s, maxlen)    strx_u32len((const uint32_t *) (s), maxlen)
+#else
+#  define wcsxlen(s, maxlen)    strx_u16len((const uint16_t *) (s), maxlen)
+#endif
+
+/**********************************************************************/
+/* Transcoding to UTF-8                                               */
+/**********************************************************************/
+
+/* Encodes a code point as UTF-8 only if the whole sequence fits
+ * before stop.  Returns NULL otherwise.
+ */
+static char *utf8_encode(char *dest, const char *stop, uint32_t cp) {
+  if (cp < 0x80) {
+    if (stop - dest < 1) return NULL;
+    *dest++ = cp;
+  } else if (cp < 0x800) {
+    if (stop - dest < 2) return NULL;
+    *dest++ = 0xc0 | (cp >> 6);
+    *dest++ = 0x80 | (cp & 0x3f);
+  } else if (cp < 0x10000) {
+    if (stop - dest < 3) return NULL;
+    *dest++ = 0xe0 | (cp >> 12);
+    *dest++ = 0x80 | ((cp >> 6) & 0x3f);
+    *dest++ = 0x80 | (cp & 0x3f);
+  } else {
+    if (stop - dest < 4) return NULL;
+    *dest++ = 0xf0 | (cp >> 18);
+    *dest++ = 0x80 | ((cp >> 12) & 0x3f);
+    *dest++ = 0x80 | ((cp >> 6) & 0x3f);
+    *dest++ = 0x80 | (cp & 0x3f);
+  }
+  return dest;
+}
+
+#define REPLACEMENT_CHARACTER 0xfffd
+
+char *strxfromu16(char *dest, const char *dest_end,
+                  const uint16_t *src, size_t n) {
+  const char *stop = dest_end - 1;
+  size_t len = strx_u16len(src, n);
+  size_t i = 0;
+
+  while (i < len && dest < stop) {
+#if defined(__SSE2__)
+    /* Eight ASCII code units at a time. */
+    const __m128i non_ascii = _mm_set1_epi16((short) 0xff80);
+    const __m128i zero = _mm_setzero_si128();
+    while (len - i >= 8 && stop - dest >= 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+      __m128i hi = _mm_and_si128(v, non_ascii);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(hi, zero)) != 0xffff)
+        break;
+      _mm_storel_epi64((__m128i *) dest, _mm_packus_epi16(v, v));
+      dest += 8;
+      i += 8;
+    }
+    if (i == len || dest >= stop)
+      break;
+#endif
+
+    uint32_t cp = src[i];
+    size_t units = 1;
+    if (cp >= 0xd800 && cp < 0xdc00 && i + 1 < len &&
+        src[i + 1] >= 0xdc00 && src[i + 1] < 0xe000) {
+      cp = 0x10000 + ((cp - 0xd800) << 10) + (src[i + 1] - 0xdc00);
+      units = 2;
+    } else if (cp >= 0xd800 && cp < 0xe000)
+      cp = REPLACEMENT_CHARACTER;  /* unpaired surrogate */
+
+    char *next = utf8_encode(dest, stop, cp);
+    if (next == NULL)
+      break;  /* do not truncate in the middle of a sequence */
+    dest = next;
+    i += units;
+  }
+
+  *dest = '\0';
+  return dest;
+}
+
+char *strxfromu32(char *dest, const char *dest_end,
+                  const uint32_t *src, size_t n) {
+  const char *stop = dest_end - 1;
+  size_t len = strx_u32len(src, n);
+  size_t i = 0;
+
+  while (i < len && dest < stop) {
+#if defined(__SSE2__)
+    /* Four ASCII code units at a time. */
+    const __m128i non_ascii = _mm_set1_epi32((int) 0xffffff80);
+    const __m128i zero = _mm_setzero_si128();
+    while (len - i >= 4 && stop - dest >= 4) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+      __m128i hi = _mm_and_si128(v, non_ascii);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(hi, zero)) != 0xffff)
+        break;
+      __m128i w = _mm_packs_epi32(v, v);
+      int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(w, w));
+      memcpy(dest, &packed, 4);
+      dest += 4;
+      i += 4;
+    }
+    if (i == len || dest >= stop)
+      break;
+#endif
+
+    uint32_t cp = src[i];
+    if (cp > 0x10ffff || (cp >= 0xd800 && cp < 0xe000))
+      cp = REPLACEMENT_CHARACTER;
+
+    char *next = utf8_encode(dest, stop, cp);
+    if (next == NULL)
+      break;  /* do not truncate in the middle of a sequence */
+    dest = next;
+    i++;
+  }
+
+  *dest = '\0';
+  return dest;
+}
+
+char *strxfromwcs(char *dest, const char *dest_end,
+                  const wchar_t *src, size_t n) {
+#if WCHAR_MAX > 0xffff
+  return strxfromu32(dest, dest_end, (const uint32_t *) src, n);
+#else
+  return strxfromu16(dest, dest_end, (const uint16_t *) src, n);
+#endif
+}
+
+/* The inverse, used by vswxprintf() for narrow string arguments.
+ * Invalid UTF-8 bytes each decode to the replacement character.
+ */
+static wchar_t *wcsxfromutf8(wchar_t *dest, const wchar_t *dest_end,
+                             const char *src, size_t n) {
+  const wchar_t *stop = dest_end - 1;
+  const unsigned char *s = (const unsigned char *) src;
+  size_t i = 0;
+
+  while (i < n && s[i] != '\0' && dest < stop) {
+    uint32_t cp = s[i];
+    size_t k = (cp < 0x80)? 1 : (cp >= 0xc2 && cp < 0xe0)? 2 :
+               (cp >= 0xe0 && cp < 0xf0)? 3 : (cp >= 0xf0 && cp < 0xf5)? 4 : 0;
+
+    size_t j;
+    if (k > 1) {
+      cp &= 0x3f >> (k - 1);
+      for (j = 1; j < k; j++) {
+        if (i + j >= n || (s[i + j] & 0xc0) != 0x80)
+          break;
+        cp = (cp << 6) | (s[i + j] & 0x3f);
+      }
+      if (j < k || cp > 0x10ffff || (cp >= 0xd800 && cp < 0xe000) ||
+          cp < ((k == 3)? 0x800u : (k == 4)? 0x10000u : 0x80u))
+        k = 0;  /* truncated, surrogate or overlong sequence */
+    }
+    if (k == 0) {
+      cp = REPLACEMENT_CHARACTER;
+      k = 1;
+    }
+
+#if WCHAR_MAX <= 0xffff
+    if (cp >= 0x10000) {
+      if (stop - dest < 2)
+        break;  /* do not split a surrogate pair */
+      *dest++ = 0xd800 + ((cp - 0x10000) >> 10);
+      *dest++ = 0xdc00 + ((cp - 0x10000) & 0x3ff);
+      i += k;
+      continue;
+    }
+#endif
+
+    *dest++ = cp;
+    i += k;
+  }
+
+  *dest = L'\0';
+  return dest;
+}
+
+/**********************************************************************/
+/* Wide character string buffer operations                            */
+/**********************************************************************/
+
+wchar_t *wcsxcpy(wchar_t *dest, const wchar_t *dest_end,
+                 const wchar_t *src, size_t n) {
+  size_t avail = dest_end - dest - 1;
+  size_t len = wcsxlen(src, (n < avail)? n : avail);
+  memcpy(dest, src, len * sizeof(wchar_t));
+  dest += len;
+  *dest = L'\0';
+
+  return dest;
+}
+
+wchar_t *wcsxfromull(wchar_t *dest, const wchar_t *dest_end,
+                     unsigned long long int x, int base,
+                     const wchar_t *digits) {
+  assert(base >= 8 && base <= 16);
+
+  wchar_t buf[sizeof(unsigned long long) * 8 / 3 + 1];  /* max for oct */
+  wchar_t *p = buf;
+  while (x) {
+    *p++ = digits[x % base];
+    x /= base;
+  }
+
+  if (p == buf)  /* in case x was zero to begin with */
+    *p++ = L'0';
+
+  const wchar_t *stop = dest_end - 1;
+  while (dest < stop && p > buf)
+    *dest++ = *--p;
+  *dest = L'\0';
+
+  return dest;
+}
+
+/* Mirrors vsxprintf(), except that %s takes a UTF-8 string and %ls
+ * takes a wide string, like swprintf() does.
+ */
+wchar_t *vswxprintf(wchar_t *dest, const wchar_t *dest_end,
+                    const wchar_t *fmt, va_list ap) {
+  const wchar_t *stop = dest_end - 1;
+
+  while (dest < stop) {
+    wchar_t c = *fmt;
+
+    if (c == L'\0')
+      break;
+
+    if (c != L'%') {
+      *dest++ = c;
+      ++fmt;
+      continue;
+    }
+
+    /* begin format specification */
+
+    c = *++fmt;
+
+    if (c == L'%') {
+      *dest++ = L'%';
+      ++fmt;
+      continue;
+    }
+
+    if (c >= L'1' && c <= L'9')
+      abort();  /* argument selector is not implemented */
+
+    /* Flags are recognized but not yet honored. */
+    while (c == L'#' || c == L'0' || c == L'-' || c == L' ' || c == L'+' ||
+           c == L'\'')
+      c = *++fmt;
+
+    while (c >= L'0' && c <= L'9')  /* field width is not honored */
+      c = *++fmt;
+
+    int prec = -1;
+    if (c == L'.') {  /* only honored by floating point conversion */
+      prec = 0;
+      for (c = *++fmt; c >= L'0' && c <= L'9'; c = *++fmt)
+        prec = prec * 10 + (c - L'0');
+    }
+
+    /* parse length modifier */
+
+    char len = sizeof(int);
+    char wide = 0;
+    switch (c) {
+    case L'h':
+      c = *++fmt;
+      if (c == L'h') {
+        c = *++fmt;
+        len = sizeof(char);
+      } else
+        len = sizeof(short int);
+      break;
+    case L'l':
+      c = *++fmt;
+      wide = 1;
+      if (c == L'l') {
+        c = *++fmt;
+        len = sizeof(long long int);
+      } else
+        len = sizeof(long int);
+      break;
+    case L'j': c = *++fmt; len = sizeof(intmax_t); break;
+    case L't': c = *++fmt; len = sizeof(ptrdiff_t); break;
+    case L'z': c = *++fmt; len = sizeof(size_t); break;
+    case L'q':
+      abort();  /* quad_t is not supported */
+      break;
+    }
+
+    ++fmt;
+
+    /* integer conversion */
+
+    char convert = 1;
+    char sign = 1;
+    char base = 10;
+    const wchar_t *digits = L"0123456789abcdef";
+
+    switch (c) {
+    case L'd': case L'i': sign = 1; base = 10; break;
+    case L'o': sign = 0; base = 8; break;
+    case L'u': sign = 0; base = 10; break;
+
+    case L'X': digits = L"0123456789ABCDEF";
+      /* fall through */
+    case L'x': sign = 0; base = 16; break;
+
+    case L'D': len = sizeof(long int); sign = 1; base = 10; break;
+    case L'O': len = sizeof(long int); sign = 0; base = 8; break;
+    case L'U': len = sizeof(long int); sign = 0; base = 10; break;
+
+    case L'p':
+      dest = wcsxcpy(dest, dest_end, L"0x", SIZE_MAX);
+      len = sizeof(void *); sign = 0; base = 16; break;
+
+    default:
+      convert = 0;
+    }
+
+    if (convert) {
+      unsigned long long int x;
+      if (sign) {
+        long long int y;
+        switch (len) {
+        case sizeof(int8_t): y = (int8_t) va_arg(ap, int /* promoted */); break;
+        case sizeof(int16_t): y = (int16_t) va_arg(ap, int /* promoted */); break;
+        case sizeof(int32_t): y = va_arg(ap, int32_t); break;
+        case sizeof(int64_t): y = va_arg(ap, int64_t); break;
+        default: abort();
+        }
+
+        if (y < 0) {
+          *dest++ = L'-';
+          if (dest >= stop) break;
+        }
+        x = (y < 0)? -(unsigned long long int) y : (unsigned long long int) y;
+      } else {
+        switch (len) {
+        case sizeof(int8_t): x = (uint8_t) va_arg(ap, int /* promoted */); break;
+        case sizeof(int16_t): x = (uint16_t) va_arg(ap, int /* promoted */); break;
+        case sizeof(int32_t): x = va_arg(ap, uint32_t); break;
+        case sizeof(int64_t): x = va_arg(ap, uint64_t); break;
+        default: abort();
+        }
+      }
+
+      dest = wcsxfromull(dest, dest_end, x, base, digits);
+      continue;
+    }
+
+    /* double conversion, formatted narrow and widened */
+
+    if (c == L'f' || c == L'F') {
+      char buf[64];
+      char *end = strxfromd(buf, buf + sizeof(buf), va_arg(ap, double),
+                            (prec < 0)? 6 : prec);
+      dest = wcsxfromutf8(dest, dest_end, buf, end - buf);
+      continue;
+    }
+
+    if (c == L'a' || c == L'A' || c == L'e' || c == L'E' ||
+        c == L'g' || c == L'G') {
+      (void) va_arg(ap, double);
+      dest = wcsxcpy(dest, dest_end, L"<double>", SIZE_MAX);  /* placeholder */
+      continue;
+    }
+
+    /* other conversion */
+
+    switch (c) {
+    case L'c':
+      *dest++ = wide? (wchar_t) va_arg(ap, wint_t) :
+                      (wchar_t) (unsigned char) va_arg(ap, int /* promoted */);
+      continue;
+    case L's':
+      if (wide)
+        dest = wcsxcpy(dest, dest_end, va_arg(ap, const wchar_t *), SIZE_MAX);
+      else
+        dest = wcsxfromutf8(dest, dest_end, va_arg(ap, const char *), SIZE_MAX);
+      continue;
+    default:
+      abort();
+    }
+  }
+
+  *dest = L'\0';
+  return dest;
+}
+
+wchar_t *swxprintf(wchar_t *dest, const wchar_t *dest_end,
+                   const wchar_t *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  wchar_t *res = vswxprintf(dest, dest_end, fmt, ap);
+  va_end(ap);
+  return res;
+}
@@ -0,0 +1,191 @@
+#include "stringx.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wchar.h>
+
+/* Strings placed right before an inaccessible page, so that reading
+ * past the terminator across the page boundary faults.
+ */
+static char *g_page_end;
+
+static int check_lengths(int unit_size)
+{
+  int failures = 0;
+  size_t len, off, k;
+
+  /* Byte offsets from a 16-byte boundary, including ones that are not
+   * a multiple of the unit size, which take the scalar loop.
+   */
+  for (off = 0; off < 16; off++)
+    for (len = 0; len <= 40; len++) {
+      /* The terminator within 16 bytes of the page end, or in the
+       * middle of the page.
+       */
+      char *starts[2] = {
+        g_page_end - (len + 1) * unit_size - off,
+        g_page_end - 4096 + 16 + off,
+      };
+      for (k = 0; k < 2; k++) {
+        char *s = starts[k];
+        size_t maxlens[] = { SIZE_MAX, len + 1, len, len / 2, 0 };
+        size_t i, m;
+        memset(s, 0x41, (len + 1) * unit_size);
+        memset(s + len * unit_size, 0, unit_size);
+        for (m = 0; m < sizeof(maxlens) / sizeof(maxlens[0]); m++) {
+          size_t expected = (len < maxlens[m])? len : maxlens[m];
+          size_t got = (unit_size == 2)?
+            strx_u16len((const uint16_t *) s, maxlens[m]) :
+            strx_u32len((const uint32_t *) s, maxlens[m]);
+          failures += got != expected;
+        }
+        for (i = 0; i < len * unit_size; i += unit_size)
+          s[i] = 0;  /* zero bytes within a unit are not terminators */
+        failures += ((unit_size == 2)?
+                     strx_u16len((const uint16_t *) s, SIZE_MAX) :
+                     strx_u32len((const uint32_t *) s, SIZE_MAX)) != len;
+      }
+    }
+
+  /* No terminator at all, with maxlen stopping at the page boundary. */
+  for (off = 0; off < 64; off += unit_size) {
+    char *s = g_page_end - off;
+    size_t n = off / unit_size;
+    memset(s, 0x41, off);
+    failures += ((unit_size == 2)?
+                 strx_u16len((const uint16_t *) s, n) :
+                 strx_u32len((const uint32_t *) s, n)) != n;
+  }
+
+  printf("u%dlen: %s\n", unit_size * 8, failures? "FAILED" : "ok");
+  return failures;
+}
+
+/* Transcodes src of n units at every buffer size up to one byte past
+ * the whole output, which must always be the longest prefix of
+ * expected that ends on a sequence boundary.
+ */
+static int check_transcode(const char *label,
+                           char *(*from)(char *, const char *,
+                                         const void *, size_t),
+                           const void *src, size_t n, const char *expected)
+{
+  size_t expected_len = strlen(expected), size;
+  char buf[256];
+  int failures = 0;
+
+  for (size = 1; size <= expected_len + 2; size++) {
+    size_t fit = size - 1;
+    while (fit > 0 && fit < expected_len &&
+           (expected[fit] & 0xc0) == 0x80)  /* continuation byte */
+      fit--;
+    if (fit > expected_len)
+      fit = expected_len;
+
+    memset(buf, 0x7f, sizeof(buf));
+    char *end = from(buf, buf + size, src, n);
+    int ok = end == buf + fit && *end == '\0' &&
+      memcmp(buf, expected, fit) == 0;
+    if (!ok)
+      printf("%s: size %zu: got %zu bytes, expected %zu\n",
+             label, size, (size_t) (end - buf), fit);
+    failures += !ok;
+  }
+
+  printf("%s: %s\n", label, failures? "FAILED" : "ok");
+  return failures;
+}
+
+static char *from_u16(char *dest, const char *dest_end,
+                      const void *src, size_t n)
+{
+  return strxfromu16(dest, dest_end, (const uint16_t *) src, n);
+}
+
+static char *from_u32(char *dest, const char *dest_end,
+                      const void *src, size_t n)
+{
+  return strxfromu32(dest, dest_end, (const uint32_t *) src, n);
+}
+
+static char *from_wcs(char *dest, const char *dest_end,
+                      const void *src, size_t n)
+{
+  return strxfromwcs(dest, dest_end, (const wchar_t *) src, n);
+}
+
+#define REPLACEMENT     "\xef\xbf\xbd"
+
+int main()
+{
+  int failures = 0;
+
+  long page_size = sysconf(_SC_PAGESIZE);
+  char *pages = (char *) mmap(NULL, 2 * page_size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pages == MAP_FAILED || mprotect(pages + page_size, page_size,
+                                      PROT_NONE) == -1) {
+    perror("mmap");
+    return 1;
+  }
+  g_page_end = pages + page_size;
+
+  failures += check_lengths(2);
+  failures += check_lengths(4);
+
+  /* ASCII runs long enough for the vector loops, then 2, 3 and 4 byte
+   * sequences.
+   */
+  static const uint16_t u16[] = {
+    'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j',
+    0xe9, 0x20ac, 0xd83d, 0xde00,
+    'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 0
+  };
+  const char *expected16 =
+    "abcdefghij" "\xc3\xa9" "\xe2\x82\xac" "\xf0\x9f\x98\x80" "klmnopqr";
+  failures += check_transcode("u16", from_u16, u16, SIZE_MAX, expected16);
+
+  /* Unpaired surrogates: a low one alone, a high one followed by a
+   * non-surrogate, a high one at the end, and a pair split by n.
+   */
+  static const uint16_t unpaired[] = {
+    'x', 0xdc00, 'y', 0xd800, 'z', 0xdbff, 0
+  };
+  failures += check_transcode("unpaired", from_u16, unpaired, SIZE_MAX,
+                              "x" REPLACEMENT "y" REPLACEMENT "z" REPLACEMENT);
+  failures += check_transcode("split pair", from_u16, u16, 13,
+                              "abcdefghij" "\xc3\xa9" "\xe2\x82\xac"
+                              REPLACEMENT);
+
+  static const uint32_t u32[] = {
+    'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i',
+    0xe9, 0x20ac, 0x1f600, 0xd800, 0x110000, 'k', 'l', 'm', 'n', 'o', 0
+  };
+  const char *expected32 =
+    "abcdefghi" "\xc3\xa9" "\xe2\x82\xac" "\xf0\x9f\x98\x80"
+    REPLACEMENT REPLACEMENT "klmno";
+  failures += check_transcode("u32", from_u32, u32, SIZE_MAX, expected32);
+  failures += check_transcode("u32 n", from_u32, u32, 11,
+                              "abcdefghi" "\xc3\xa9" "\xe2\x82\xac");
+
+  static const wchar_t wcs[] = L"wide é€\U0001f600 string";
+  failures += check_transcode("wcs", from_wcs, wcs, SIZE_MAX,
+                              "wide \xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80"
+                              " string");
+
+  /* And back, through swxprintf(). */
+  wchar_t wbuf[64];
+  swxprintf(wbuf, wbuf + 64, L"%s|%ls",
+            "\xc3\xa9\xf0\x9f\x98\x80" "\xff", L"w");
+  int res = wcscmp(wbuf, L"é\U0001f600�|w") != 0;
+  printf("swxprintf: %s\n", res? "FAILED" : "ok");
+  failures += res;
+
+  munmap(pages, 2 * page_size);
+
+  printf("%s\n", failures? "FAIL" : "PASS");
+  return failures != 0;
+}